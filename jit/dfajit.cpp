@@ -0,0 +1,200 @@
+#include "dfajit.hpp"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Verifier.h>
+
+#include <map>
+#include <memory>
+
+// generate LLVM IR of the matcher for a fully built DFA
+//
+// C code:
+// bool name(const char *str, size_t len) {
+//     size_t i = 0;
+// s0:
+//     if (i == len)
+//         return false;
+//     switch (byteClass[str[i++]]) {
+//     case 0:
+//         goto s1;
+//     ...
+//     }
+// s1:
+//     ...
+// }
+//
+// the switches are on byte classes (see computeByteClasses) through a
+// constant table, so that a state has a case per class rather than per byte.
+// a transition to a state which has "match" returns true, and a transition
+// to no state returns false
+//
+// return nullptr if the generated function does not pass the verifier
+llvm::Function *genDFAIR(const DFA &dfa, llvm::Module &module,
+                         const std::string &name) {
+    auto &ctx = module.getContext();
+    llvm::IRBuilder<> builder(ctx);
+
+    // create the type of the function
+    auto boolType = llvm::IntegerType::get(ctx, 1);
+    auto charType = llvm::IntegerType::get(ctx, 8);
+    auto sizeType = llvm::IntegerType::get(ctx, 64);
+    std::vector<llvm::Type *> argType;
+    argType.push_back(llvm::PointerType::getUnqual(charType));
+    argType.push_back(sizeType);
+    auto funcType = llvm::FunctionType::get(boolType, argType, false);
+
+    // create the prototype of function
+    auto funcDef = llvm::Function::Create(
+        funcType, llvm::Function::ExternalLinkage, name, &module);
+
+    // create the table of byte classes
+    const Program &prog = dfa.program();
+    uint32_t numClasses = prog.numByteClasses;
+    auto tableType = llvm::ArrayType::get(charType, 256);
+    std::vector<llvm::Constant *> classes;
+    for (int b = 0; b < 256; b++)
+        classes.push_back(llvm::ConstantInt::get(charType, prog.byteClass[b]));
+    auto table = new llvm::GlobalVariable(
+        module, tableType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(tableType, classes), name + ".classes");
+
+    // a byte of every byte class
+    std::vector<uint8_t> rep(numClasses);
+    for (int b = 255; b >= 0; b--)
+        rep[prog.byteClass[b]] = b;
+
+    auto arg = funcDef->arg_begin();
+    llvm::Value *str = &*arg++;
+    llvm::Value *len = &*arg;
+
+    // create blocks
+    auto entryBlock = llvm::BasicBlock::Create(ctx, "entry", funcDef);
+    auto matchBlock = llvm::BasicBlock::Create(ctx, "match", funcDef);
+    auto failBlock = llvm::BasicBlock::Create(ctx, "fail", funcDef);
+
+    // one block to test the end of the input and one block to switch on
+    // the next byte for every state
+    size_t n = dfa.numStates();
+    std::vector<llvm::BasicBlock *> stateBlocks(n), bodyBlocks(n);
+    std::vector<llvm::PHINode *> index(n);
+    for (size_t s = 0; s < n; s++) {
+        auto id = std::to_string(s);
+        stateBlocks[s] = llvm::BasicBlock::Create(ctx, "s" + id, funcDef);
+        bodyBlocks[s] = llvm::BasicBlock::Create(ctx, "body" + id, funcDef);
+
+        builder.SetInsertPoint(stateBlocks[s]);
+        index[s] = builder.CreatePHI(sizeType, 0, "i" + id);
+    }
+
+    // entry: goto the start state
+    builder.SetInsertPoint(entryBlock);
+    int32_t start = dfa.start();
+    if (dfa.isMatch(start)) {
+        builder.CreateBr(matchBlock);
+    } else {
+        builder.CreateBr(stateBlocks[start]);
+        index[start]->addIncoming(llvm::ConstantInt::get(sizeType, 0),
+                                  entryBlock);
+    }
+
+    // match: return true
+    builder.SetInsertPoint(matchBlock);
+    builder.CreateRet(llvm::ConstantInt::get(boolType, 1));
+
+    // fail: return false
+    builder.SetInsertPoint(failBlock);
+    builder.CreateRet(llvm::ConstantInt::get(boolType, 0));
+
+    for (size_t s = 0; s < n; s++) {
+        auto id = std::to_string(s);
+
+        if (dfa.isMatch(s)) {
+            // only the start state can be reached with "match"
+            builder.SetInsertPoint(stateBlocks[s]);
+            builder.CreateBr(matchBlock);
+            builder.SetInsertPoint(bodyBlocks[s]);
+            builder.CreateUnreachable();
+            continue;
+        }
+
+        // s: if (i == len) return false;
+        builder.SetInsertPoint(stateBlocks[s]);
+        auto end = builder.CreateICmpEQ(index[s], len, "end" + id);
+        builder.CreateCondBr(end, failBlock, bodyBlocks[s]);
+
+        // body: switch (byteClass[str[i++]])
+        builder.SetInsertPoint(bodyBlocks[s]);
+        auto ptr = builder.CreateGEP(charType, str, index[s], "p" + id);
+        auto c = builder.CreateLoad(charType, ptr, "c" + id);
+        auto b = builder.CreateZExt(c, sizeType, "b" + id);
+        llvm::Value *zero = llvm::ConstantInt::get(sizeType, 0);
+        auto kptr = builder.CreateInBoundsGEP(tableType, table, {zero, b},
+                                              "kp" + id);
+        auto k = builder.CreateLoad(charType, kptr, "k" + id);
+        auto next = builder.CreateAdd(index[s],
+                                      llvm::ConstantInt::get(sizeType, 1),
+                                      "next" + id);
+
+        // the most frequent target becomes the default of the switch
+        std::map<int32_t, int> freq;
+        for (uint32_t j = 0; j < numClasses; j++)
+            freq[dfa.transition(s, rep[j])]++;
+
+        int32_t def = DFA_DEAD;
+        int maxFreq = 0;
+        for (auto &f : freq) {
+            if (f.second > maxFreq) {
+                def = f.first;
+                maxFreq = f.second;
+            }
+        }
+
+        auto target = [&](int32_t t) -> llvm::BasicBlock * {
+            if (t == DFA_MATCH)
+                return matchBlock;
+            if (t < 0)
+                return failBlock;
+            // every edge needs an incoming value of the PHI of i
+            index[t]->addIncoming(next, bodyBlocks[s]);
+            return stateBlocks[t];
+        };
+
+        auto sw = builder.CreateSwitch(k, target(def), numClasses - maxFreq);
+        for (uint32_t j = 0; j < numClasses; j++) {
+            int32_t t = dfa.transition(s, rep[j]);
+            if (t != def)
+                sw->addCase(llvm::ConstantInt::get(charType, j), target(t));
+        }
+    }
+
+    // the verifier prints what is wrong, and a broken function is not
+    // compiled
+    if (llvm::verifyFunction(*funcDef, &llvm::errs())) {
+        funcDef->eraseFromParent();
+        return nullptr;
+    }
+
+    return funcDef;
+}
+
+JITMatcher compileRegex(llvm::orc::RegexJIT &jit, llvm::LLVMContext &ctx,
+                        const Program &prog, size_t budget) {
+    DFA dfa(prog, budget);
+    if (!dfa.build())
+        return nullptr;
+
+    // every matcher lives in a module of its own
+    static int id = 0;
+    std::string name = "__regex" + std::to_string(id++);
+
+    auto module = std::make_unique<llvm::Module>(name, ctx);
+    module->setDataLayout(jit.getTargetMachine().createDataLayout());
+    if (genDFAIR(dfa, *module, name) == nullptr)
+        return nullptr;
+
+    jit.addModule(std::move(module));
+
+    // find address of the function
+    auto symbol = jit.findSymbol(name);
+    return (JITMatcher)(*symbol.getAddress());
+}
@@ -0,0 +1,28 @@
+#ifndef DFAJIT_HPP
+#define DFAJIT_HPP
+
+#include "../src/dfa.hpp"
+#include "regexjit.hpp"
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+// a JIT-compiled matcher
+// return true if str[0..len) has a match
+typedef bool (*JITMatcher)(const char *str, size_t len);
+
+// generate LLVM IR of the matcher for a fully built DFA
+// every DFA state becomes a basic block which switches on the byte class of
+// the next byte
+// return nullptr if the function does not pass the verifier
+llvm::Function *genDFAIR(const DFA &dfa, llvm::Module &module,
+                         const std::string &name);
+
+// compile a program generated by genCode to native code through jit
+// return nullptr if the DFA of prog does not fit in budget bytes, or if its
+// IR does not pass the verifier
+JITMatcher compileRegex(llvm::orc::RegexJIT &jit, llvm::LLVMContext &ctx,
+                        const Program &prog, size_t budget = 1 << 24);
+
+#endif // DFAJIT_HPP
@@ -1,6 +1,12 @@
 #include <cctype>
+#include <fstream>
 #include <iostream>
 
+#include "../src/codegen.hpp"
+#include "../src/optimize.hpp"
+#include "../src/parser.hpp"
+#include "../src/simplify.hpp"
+#include "dfajit.hpp"
 #include "regexjit.hpp"
 
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
@@ -126,12 +132,55 @@ llvm::Function *makeExample() {
     return funcDef;
 }
 
+// runRegex compiles regex to native code, and prints the lines of file
+// which match it
+int runRegex(llvm::orc::RegexJIT &jit, char *regex, const char *file) {
+    // parse regex
+    TRTree ast;
+    if (!parseRegex(regex, ast))
+        return 1;
+    simplifyRegex(ast, false);
+
+    // generate code
+    auto prog = genCode(genLCode(ast));
+    optimizeCode(prog, false);
+
+    // JIT compilation
+    auto matcher = compileRegex(jit, llvmCtx, prog);
+    if (matcher == nullptr) {
+        std::cerr << "failed to compile: " << regex << std::endl;
+        return 1;
+    }
+
+    // open file
+    std::ifstream ifs(file);
+    std::string str;
+    if (ifs.fail()) {
+        std::cerr << "failed to open file: " << file << std::endl;
+        return 2;
+    }
+
+    uint64_t line = 0;
+    while (getline(ifs, str)) {
+        line++;
+        if (matcher(str.data(), str.size()))
+            std::cout << line << ": " << str << std::endl;
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     // initialize
     llvm::InitializeNativeTarget();
     llvm::InitializeNativeTargetAsmPrinter();
     llvm::InitializeNativeTargetAsmParser();
 
+    llvm::orc::RegexJIT jit;
+
+    if (argc > 2)
+        return runRegex(jit, argv[1], argv[2]);
+
     // generate LLVM IR
     auto func = makeExample();
 
@@ -142,7 +191,6 @@ int main(int argc, char *argv[]) {
     std::cout << s << std::endl;
 
     // JIT compilation
-    llvm::orc::RegexJIT jit;
     jit.addModule(std::move(llvmModule));
 
     // find address of the function
@@ -0,0 +1,153 @@
+#include "aot.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <vector>
+
+// special values of the transitions of a matcher generated from a lazy DFA
+#define AOT_MATCH -1
+#define AOT_DEAD -2
+
+// write the beginning of the header up to the body of the matcher, and
+// return its include guard
+static std::string genPrologue(const std::string &name,
+                               const std::string &regex, std::ostream &out) {
+    // the regex in a comment, where a line break would end the comment
+    std::string comment;
+    for (char c : regex) {
+        if (c == '\n')
+            comment += "\\n";
+        else if (c == '\r')
+            comment += "\\r";
+        else
+            comment += c;
+    }
+
+    std::string guard;
+    for (char c : name)
+        guard += toupper((unsigned char)c);
+    guard += "_HPP";
+
+    out << "// generated by tinyregex -g " << name << "\n"
+        << "// regex: \"" << comment << "\"\n"
+        << "\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n"
+        << "\n"
+        << "#include <cstddef>\n"
+        << "#include <cstdint>\n"
+        << "\n"
+        << "// return true if str[0..len) has a match of the regex\n"
+        << "inline bool " << name << "(const char *str, size_t len) {\n";
+    return guard;
+}
+
+static void genByteClasses(const uint8_t *byteClass, std::ostream &out) {
+    out << "    static const uint8_t byteClass[256] = {";
+    for (int b = 0; b < 256; b++)
+        out << (b % 16 == 0 ? "\n        " : " ") << (int)byteClass[b] << ",";
+    out << "\n    };\n";
+}
+
+void genDFAHeader(const DenseDFA &dense, const std::string &name,
+                  const std::string &regex, std::ostream &out) {
+    std::string guard = genPrologue(name, regex, out);
+    genByteClasses(dense.byteClasses(), out);
+
+    // a line per state, broken every 16 transitions
+    uint32_t numClasses = dense.numClasses();
+    const std::vector<uint16_t> &trans = dense.transitions();
+    out << "\n"
+        << "    // the offsets of the rows of the next states, where the rows "
+           "at 0 and at\n"
+        << "    // " << numClasses
+        << " are the states without and with a match\n"
+        << "    static const uint16_t trans[" << trans.size() << "] = {";
+    for (size_t i = 0; i < trans.size(); i++)
+        out << (i % numClasses % 16 == 0 ? "\n        " : " ") << trans[i]
+            << ",";
+    out << "\n    };\n";
+
+    out << "\n"
+        << "    uint32_t s = " << dense.start() << ";\n"
+        << "    for (size_t i = 0; s >= " << dense.firstState()
+        << " && i < len; i++)\n"
+        << "        s = trans[s + byteClass[(uint8_t)str[i]]];\n"
+        << "    return s == " << numClasses << ";\n"
+        << "}\n"
+        << "\n"
+        << "#endif // " << guard << "\n";
+}
+
+void genDFAHeader(const DFA &dfa, const std::string &name,
+                  const std::string &regex, std::ostream &out) {
+    const Program &prog = dfa.program();
+    uint32_t numClasses = prog.numByteClasses;
+
+    // a byte of every byte class
+    std::vector<uint8_t> rep(numClasses);
+    for (int b = 255; b >= 0; b--)
+        rep[prog.byteClass[b]] = b;
+
+    std::string guard = genPrologue(name, regex, out);
+
+    int32_t start = dfa.start();
+    if (dfa.isMatch(start)) {
+        // the empty string matches
+        out << "    (void)str;\n"
+            << "    (void)len;\n"
+            << "    return true;\n"
+            << "}\n"
+            << "\n"
+            << "#endif // " << guard << "\n";
+        return;
+    }
+
+    // the states which are not "match" are numbered from 0, and a
+    // transition is the number of its state times numClasses, so that the
+    // next transition is at trans[s + byteClass[c]]
+    size_t n = dfa.numStates();
+    std::vector<int64_t> offset(n, 0);
+    int64_t size = 0;
+    for (size_t s = 0; s < n; s++) {
+        if (dfa.isMatch(s))
+            continue;
+        offset[s] = size;
+        size += numClasses;
+    }
+    const char *type = size <= INT16_MAX ? "int16_t" : "int32_t";
+
+    genByteClasses(prog.byteClass, out);
+    out << "\n"
+        << "    // " << AOT_MATCH << ": match, " << AOT_DEAD << ": no match\n"
+        << "    static const " << type << " trans[" << size << "] = {";
+
+    // a line per state, broken every 16 transitions
+    for (size_t s = 0; s < n; s++) {
+        if (dfa.isMatch(s))
+            continue;
+        for (uint32_t k = 0; k < numClasses; k++) {
+            out << (k % 16 == 0 ? "\n        " : " ");
+            int32_t t = dfa.transition(s, rep[k]);
+            if (t == DFA_MATCH)
+                out << AOT_MATCH;
+            else if (t < 0)
+                out << AOT_DEAD;
+            else
+                out << offset[t];
+            out << ",";
+        }
+    }
+    out << "\n    };\n"
+        << "\n"
+        << "    int32_t s = " << offset[start] << ";\n"
+        << "    for (size_t i = 0; i < len; i++) {\n"
+        << "        s = trans[s + byteClass[(uint8_t)str[i]]];\n"
+        << "        if (s < 0)\n"
+        << "            return s == " << AOT_MATCH << ";\n"
+        << "    }\n"
+        << "    return false;\n"
+        << "}\n"
+        << "\n"
+        << "#endif // " << guard << "\n";
+}
@@ -0,0 +1,36 @@
+#ifndef AOT_HPP
+#define AOT_HPP
+
+#include "dense.hpp"
+#include "dfa.hpp"
+
+#include <ostream>
+#include <string>
+
+// upper bound of the memory used by the lazy DFA of a generated matcher when
+// the dense DFA is too large, as the JIT
+#define AOT_BUDGET (1 << 24)
+
+// generate a C++ header with the matcher of a dense DFA, for the regexes
+// which are known at build time
+//
+// the header defines
+//
+//     inline bool name(const char *str, size_t len);
+//
+// which returns true if str[0..len) has a match, as DenseDFA::match. the
+// byte classes and the transitions are constant tables, so the matcher
+// neither parses nor builds anything at run time, and the compiler may
+// inline it
+// (a switch per state, as genDFAIR of the JIT, mispredicts on most inputs)
+void genDFAHeader(const DenseDFA &dense, const std::string &name,
+                  const std::string &regex, std::ostream &out);
+
+// same as above for a fully built lazy DFA (see DFA::build), which is not
+// minimized, and whose transitions are 32-bit offsets when they do not fit
+// in 16 bits, for the regexes with more than DENSE_MAX_TRANSITIONS
+// transitions
+void genDFAHeader(const DFA &dfa, const std::string &name,
+                  const std::string &regex, std::ostream &out);
+
+#endif // AOT_HPP
@@ -0,0 +1,33 @@
+#include "batch.hpp"
+
+BatchMatcher::BatchMatcher(const Program &prog, bool anchored,
+                           const Glushkov *glushkov)
+    : m_anchored(anchored), m_glushkov(glushkov),
+      m_dfa(prog, 1 << 20, anchored) {}
+
+const std::vector<uint64_t> &BatchMatcher::match(const StringRef *strs,
+                                                 size_t n) {
+    m_bits.resize((n + 63) / 64);
+    size_t bytes = 0;
+    for (size_t i = 0; i < n; i++)
+        bytes += strs[i].len;
+
+    size_t matches;
+    if (m_glushkov != nullptr) {
+        matches = m_glushkov->matchBatch(strs, n, m_bits.data(), m_anchored);
+        m_stats.glushkovBytes += bytes;
+    } else {
+        matches = m_dfa.matchBatch(strs, n, m_bits.data());
+    }
+
+    m_stats.lines += n;
+    m_stats.bytes += bytes;
+    m_stats.matches += matches;
+    return m_bits;
+}
+
+Stats BatchMatcher::stats() const {
+    Stats s = m_stats;
+    m_dfa.addStats(s);
+    return s;
+}
@@ -0,0 +1,46 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "codegen.hpp"
+#include "dfa.hpp"
+#include "glushkov.hpp"
+#include "stats.hpp"
+#include "stringref.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// matcher of one regex against batches of many short strings, like the
+// fields of records
+//
+// the strings of a batch are scanned by the lazy DFA, or by the Glushkov
+// automaton if it is given, several strings at once (see DFA::matchBatch),
+// and the states of the DFA and the bitmap are kept across the batches, so
+// a string costs no setup of its own
+class BatchMatcher {
+  public:
+    // anchored: if true, a match must start at the beginning of a string,
+    //           as evalRegex
+    // glushkov: if not nullptr, the automaton of the same regex, which
+    //           matches instead of the DFA
+    BatchMatcher(const Program &prog, bool anchored = false,
+                 const Glushkov *glushkov = nullptr);
+
+    // return the bitmap of the strings of strs[0..n) which match, where the
+    // bit i % 64 of the word i / 64 is set if strs[i] matches, which is
+    // valid until the next call
+    const std::vector<uint64_t> &match(const StringRef *strs, size_t n);
+
+    // the counters of the batches so far
+    Stats stats() const;
+
+  private:
+    bool m_anchored;
+    const Glushkov *m_glushkov;
+    DFA m_dfa;
+    std::vector<uint64_t> m_bits;
+
+    Stats m_stats; // the counters but the ones of the DFA
+};
+
+#endif // BATCH_HPP
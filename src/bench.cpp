@@ -0,0 +1,385 @@
+#include "batch.hpp"
+#include "codegen.hpp"
+#include "dense.hpp"
+#include "glushkov.hpp"
+#include "literal.hpp"
+#include "optimize.hpp"
+#include "parser.hpp"
+#include "scan.hpp"
+#include "search.hpp"
+#include "simplify.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// default size of a corpus in bytes
+#define BENCH_SIZE (4 << 20)
+
+// number of times a regex is compiled to time the compilation
+#define BENCH_COMPILES 200
+
+// size of a block given to StreamMatcher::feed
+#define BENCH_BLOCK_SIZE (1 << 16)
+
+// a corpus is generated from a seed, so every run scans the same bytes
+enum Corpus {
+    CORPUS_LOG,  // log lines of a web server
+    CORPUS_DNA,  // lines of 80 bases
+    CORPUS_TEXT, // lines of english-like words
+    CORPUS_LONG, // one line of random letters
+    CORPUS_A,    // short lines of 'a'
+    CORPUS_LONGA // lines of 100 'a'
+};
+
+static const char *corpusNames[] = {"log", "dna", "text", "long", "a", "longa"};
+
+struct Case {
+    const char *name;
+    Corpus corpus;
+    const char *regex;
+    int shrink; // the corpus is BENCH_SIZE >> shrink bytes
+};
+
+// realistic patterns, and pathological ones which the backtracking engines
+// take exponential time or the DFA takes exponential space for
+static const Case cases[] = {
+    {"log-literal", CORPUS_LOG, "ERROR", 0},
+    {"log-request", CORPUS_LOG, "(GET|POST)\\ \\/api\\/v[0-9]+\\/\\w+", 0},
+    {"log-slow", CORPUS_LOG, "took\\ [0-9]{4,}ms", 0},
+    {"log-ip", CORPUS_LOG, "[0-9]{1,3}(\\.[0-9]{1,3}){3}", 0},
+    {"dna-literal", CORPUS_DNA, "AGGGTAAA", 0},
+    {"dna-class", CORPUS_DNA, "[CGT]GGGTAAA|TTTACCC[ACG]", 0},
+    {"text-words", CORPUS_TEXT, "(quick|lazy)\\ \\w+\\ (fox|dog)", 0},
+    {"text-none", CORPUS_TEXT, "zzz\\w*q", 0},
+    {"long-class", CORPUS_LONG, "[a-q][^u-z]{13}x", 0},
+    {"long-star", CORPUS_LONG, "q.*u.*x.*z", 0},
+    {"patho-optional", CORPUS_A, "(a?){25}a{25}", 3},
+    {"patho-nested", CORPUS_LONGA, "(a*)*b", 3},
+    {"patho-alternate", CORPUS_LONGA, "(a|aa)*c", 3},
+    {"patho-plus", CORPUS_LONGA, "(a+a+)+b", 3},
+};
+
+// xorshift, which is enough for generating text
+static uint64_t randomState;
+
+static uint32_t random32() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)(randomState >> 32);
+}
+
+static void appendNumber(std::string &s, uint32_t n) {
+    char num[16];
+    snprintf(num, sizeof(num), "%u", n);
+    s += num;
+}
+
+static std::string generate(Corpus corpus, size_t size) {
+    static const char *words[] = {
+        "the",  "quick", "brown", "fox",  "jumps", "over", "lazy",
+        "dog",  "and",   "then",  "runs", "away",  "from", "a",
+        "cat",  "which", "sat",   "on",   "mat",   "with", "hat"};
+    static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN",
+                                   "ERROR"};
+    static const char *methods[] = {"GET", "GET", "POST", "PUT", "DELETE"};
+    static const char *paths[] = {"users", "orders", "items", "login",
+                                  "search"};
+
+    randomState = 88172645463325252ULL;
+    std::string s;
+    s.reserve(size + 256);
+
+    while (s.size() < size) {
+        switch (corpus) {
+        case CORPUS_LOG:
+            s += "2024-03-";
+            appendNumber(s, 10 + random32() % 20);
+            s += " 12:";
+            appendNumber(s, 10 + random32() % 50);
+            s += " ";
+            s += levels[random32() % 6];
+            s += " ";
+            for (int i = 0; i < 4; i++) {
+                if (i > 0)
+                    s += ".";
+                appendNumber(s, random32() % 256);
+            }
+            s += " ";
+            s += methods[random32() % 5];
+            s += " /api/v";
+            appendNumber(s, 1 + random32() % 3);
+            s += "/";
+            s += paths[random32() % 5];
+            s += " status=";
+            appendNumber(s, random32() % 8 == 0 ? 500 : 200);
+            s += " took ";
+            appendNumber(s, random32() % (random32() % 100 == 0 ? 20000 : 900));
+            s += "ms\n";
+            break;
+        case CORPUS_DNA:
+            for (int i = 0; i < 80; i++)
+                s += "ACGT"[random32() % 4];
+            s += "\n";
+            break;
+        case CORPUS_TEXT:
+            for (int i = 0; i < 12; i++) {
+                if (i > 0)
+                    s += " ";
+                s += words[random32() % 21];
+            }
+            s += "\n";
+            break;
+        case CORPUS_LONG:
+            s += 'a' + random32() % 26;
+            break;
+        case CORPUS_A:
+            s += std::string(25, 'a') + "\n";
+            break;
+        case CORPUS_LONGA:
+            s += std::string(100, 'a') + "\n";
+            break;
+        }
+    }
+
+    if (corpus == CORPUS_LONG)
+        s += "\n";
+    return s;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start) {
+    auto d = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(d).count();
+}
+
+// write s as a JSON string
+static void printString(const char *s) {
+    putchar('"');
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+// run a case by an engine, and print the result as one JSON object
+static void run(const Case &c, const char *engine, size_t size) {
+    std::string expr(c.regex);
+    std::vector<char> buf;
+
+    // time every phase of the compilation separately
+    double parseTime = 0, simplifyTime = 0, lcodeTime = 0, codeTime = 0, optimizeTime = 0;
+    size_t codeSize = 0;
+    Program prog;
+    Literals lits;
+    TRTree ast;
+    for (int i = 0; i < BENCH_COMPILES; i++) {
+        buf.assign(expr.begin(), expr.end());
+        buf.push_back('\0');
+
+        auto t = std::chrono::steady_clock::now();
+        if (!parseRegex(buf.data(), ast))
+            exit(1);
+        parseTime += elapsed(t);
+
+        t = std::chrono::steady_clock::now();
+        simplifyRegex(ast, false);
+        simplifyTime += elapsed(t);
+
+        t = std::chrono::steady_clock::now();
+        auto lc = genLCode(ast);
+        lcodeTime += elapsed(t);
+
+        t = std::chrono::steady_clock::now();
+        prog = genCode(lc);
+        codeTime += elapsed(t);
+
+        codeSize = prog.code.size();
+        t = std::chrono::steady_clock::now();
+        optimizeCode(prog, false);
+        optimizeTime += elapsed(t);
+
+        lits = extractLiterals(ast);
+    }
+
+    // a regex with too many positions has no result by glushkov
+    Glushkov glushkov;
+    bool useGlushkov = strcmp(engine, "glushkov") == 0;
+    if (useGlushkov && !glushkov.build(ast))
+        return;
+
+    // and a regex with too many transitions has no result by dense
+    DenseDFA dense;
+    bool useDense = strcmp(engine, "dense") == 0;
+    if (useDense && !dense.build(prog))
+        return;
+
+    std::string text = generate(c.corpus, size >> c.shrink);
+    size_t lines = 0, matches = 0;
+    double matchTime;
+
+    if (strcmp(engine, "stream") == 0) {
+        // the matches of the whole corpus, which may span lines
+        StreamMatcher matcher(prog);
+        auto t = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < text.size(); i += BENCH_BLOCK_SIZE) {
+            size_t n = std::min((size_t)BENCH_BLOCK_SIZE, text.size() - i);
+            matches += matcher.feed(text.data() + i, n);
+        }
+        matches += matcher.finish();
+        matchTime = elapsed(t);
+        lines = countLines(text.data(), text.size());
+    } else if (strcmp(engine, "batch") == 0) {
+        // the lines as one batch of strings, split before the timing
+        std::vector<StringRef> strs;
+        const char *p = text.data();
+        const char *end = p + text.size();
+        while (p < end) {
+            auto nl = (const char *)memchr(p, '\n', end - p);
+            if (nl == nullptr)
+                nl = end;
+            strs.push_back(StringRef{p, (size_t)(nl - p)});
+            p = nl + 1;
+        }
+
+        BatchMatcher matcher(prog);
+        auto t = std::chrono::steady_clock::now();
+        matcher.match(strs.data(), strs.size());
+        matchTime = elapsed(t);
+        lines = strs.size();
+        matches = matcher.stats().matches;
+    } else {
+        // the lines which match, like the command
+        Searcher searcher(prog, lits, strcmp(engine, "dfa") == 0 || useDense,
+                          false, useGlushkov ? &glushkov : nullptr, nullptr,
+                          false, useDense ? &dense : nullptr);
+        auto t = std::chrono::steady_clock::now();
+        const char *p = text.data();
+        const char *end = p + text.size();
+        while (p < end) {
+            auto nl = (const char *)memchr(p, '\n', end - p);
+            if (nl == nullptr)
+                nl = end;
+            if (searcher.match(p, nl - p))
+                matches++;
+            lines++;
+            p = nl + 1;
+        }
+        matchTime = elapsed(t);
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("{\"case\": ");
+    printString(c.name);
+    printf(", \"corpus\": ");
+    printString(corpusNames[c.corpus]);
+    printf(", \"regex\": ");
+    printString(c.regex);
+    printf(", \"engine\": ");
+    printString(engine);
+    printf(", \"bytes\": %zu, \"lines\": %zu, \"matches\": %zu", text.size(),
+           lines, matches);
+    printf(", \"parse_ns\": %.0f, \"simplify_ns\": %.0f",
+           parseTime / BENCH_COMPILES, simplifyTime / BENCH_COMPILES);
+    printf(", \"genlcode_ns\": %.0f, \"gencode_ns\": %.0f",
+           lcodeTime / BENCH_COMPILES, codeTime / BENCH_COMPILES);
+    printf(", \"optimize_ns\": %.0f, \"code_size\": %zu, "
+           "\"optimized_size\": %zu",
+           optimizeTime / BENCH_COMPILES, codeSize, prog.code.size());
+    printf(", \"match_ns\": %.0f, \"bytes_per_sec\": %.0f", matchTime,
+           text.size() / (matchTime * 1e-9));
+
+    // null if there is no match
+    printf(", \"ns_per_line\": %.1f, \"ns_per_match\": ", matchTime / lines);
+    if (matches > 0)
+        printf("%.1f", matchTime / matches);
+    else
+        printf("null");
+    printf(", \"peak_rss_kb\": %ld}\n", ru.ru_maxrss);
+}
+
+static void usage(const char *cmd) {
+    printf("usage: %s [-s size] [-e pike|dfa|dense|glushkov|stream|batch]\n"
+           "       [name...]\n"
+           "  -s size: size of a corpus in bytes (default %d)\n"
+           "  -e engine: run only the engine (default every engine)\n"
+           "  name: run only the cases whose names contain name\n"
+           "the results are printed as JSON objects, one per line\n",
+           cmd, BENCH_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *engines[] = {"pike",   "dfa",  "dense", "glushkov",
+                                    "stream", "batch"};
+    size_t size = BENCH_SIZE;
+    const char *engine = nullptr;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            size = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            engine = argv[++i];
+            if (strcmp(engine, "pike") != 0 && strcmp(engine, "dfa") != 0 &&
+                strcmp(engine, "dense") != 0 &&
+                strcmp(engine, "glushkov") != 0 &&
+                strcmp(engine, "stream") != 0 &&
+                strcmp(engine, "batch") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (const Case &c : cases) {
+        bool selected = i == argc;
+        for (int j = i; j < argc; j++) {
+            if (strstr(c.name, argv[j]) != nullptr)
+                selected = true;
+        }
+        if (!selected)
+            continue;
+
+        for (const char *e : engines) {
+            if (engine != nullptr && strcmp(engine, e) != 0)
+                continue;
+
+            // every run is a process of its own, so that the peak RSS is
+            // the one of the run
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0)
+                return 1;
+            if (pid == 0) {
+                run(c, e, size);
+                fflush(stdout);
+                _exit(0);
+            }
+
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "failed: %s by %s\n", c.name, e);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
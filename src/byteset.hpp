@@ -0,0 +1,78 @@
+#ifndef BYTESET_HPP
+#define BYTESET_HPP
+
+#include <cstdint>
+#include <string>
+
+// set of bytes as a 256-bit bitmap
+struct ByteSet {
+    uint64_t bits[4];
+
+    ByteSet() { bits[0] = bits[1] = bits[2] = bits[3] = 0; }
+
+    bool test(uint8_t c) const { return (bits[c >> 6] >> (c & 63)) & 1; }
+    void add(uint8_t c) { bits[c >> 6] |= (uint64_t)1 << (c & 63); }
+
+    void addRange(uint8_t lo, uint8_t hi) {
+        for (int c = lo; c <= hi; c++)
+            add(c);
+    }
+
+    void merge(const ByteSet &s) {
+        for (int i = 0; i < 4; i++)
+            bits[i] |= s.bits[i];
+    }
+
+    void invert() {
+        for (int i = 0; i < 4; i++)
+            bits[i] = ~bits[i];
+    }
+
+    int count() const {
+        int n = 0;
+        for (int i = 0; i < 4; i++)
+            n += __builtin_popcountll(bits[i]);
+        return n;
+    }
+
+    bool operator==(const ByteSet &s) const {
+        return bits[0] == s.bits[0] && bits[1] == s.bits[1] &&
+               bits[2] == s.bits[2] && bits[3] == s.bits[3];
+    }
+};
+
+// format a byte for printing, like "a" or "\x0a"
+inline std::string byteString(uint8_t c) {
+    static const char hex[] = "0123456789abcdef";
+    if (c > ' ' && c < 0x7f && c != '\\' && c != '-' && c != ']' && c != '^')
+        return std::string(1, (char)c);
+    std::string s = "\\x";
+    s += hex[c >> 4];
+    s += hex[c & 15];
+    return s;
+}
+
+// format a byte set for printing, like "[0-9a-z]"
+inline std::string byteSetString(const ByteSet &s) {
+    std::string ret = "[";
+    for (int c = 0; c < 256;) {
+        if (!s.test(c)) {
+            c++;
+            continue;
+        }
+
+        int lo = c;
+        while (c < 256 && s.test(c))
+            c++;
+
+        ret += byteString(lo);
+        if (c - 1 > lo) {
+            if (c - 1 > lo + 1)
+                ret += "-";
+            ret += byteString(c - 1);
+        }
+    }
+    return ret + "]";
+}
+
+#endif // BYTESET_HPP
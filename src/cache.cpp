@@ -0,0 +1,477 @@
+#include "cache.hpp"
+#include "optimize.hpp"
+#include "parser.hpp"
+#include "serial.hpp"
+#include "simplify.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// format of a cache file
+//
+// header:
+//   magic   "TRXC"
+//   version u32
+//   count   u32, number of entries
+// entry:
+//   size    u32, number of bytes of the sections
+//   sections
+// section:
+//   tag     u32
+//   size    u32, number of bytes of the data
+//   data
+//
+// every integer is in the byte order of the host, and the version tells the
+// byte order apart. a reader skips the sections with unknown tags.
+#define CACHE_MAGIC "TRXC"
+#define CACHE_VERSION 10
+
+// tags of sections
+#define SEC_PATTERN 1   // keepCaptures u8, pattern
+#define SEC_CODE 2      // instructions
+#define SEC_LITERALS 3  // exact u8, prefix size u32, prefix, inner
+#define SEC_CLASSES 4   // sets of bytes of "class"
+#define SEC_COUNTERS 5  // bounds of the counters of "repeat"
+#define SEC_CAPTURES 6  // number of capture groups u32
+#define SEC_PREFIXES 7  // exact u8, then size u32 and bytes of every prefix
+#define SEC_REVERSE 8   // reversed program: number of capture groups u32,
+                        // instructions, classes and counters (see putArray)
+#define SEC_DENSE 9     // tables of the dense DFA, if it is not empty
+#define SEC_GLUSHKOV 10 // tables of the automaton, if it is not empty
+
+bool compilePattern(const std::string &pattern, bool keepCaptures,
+                    CompiledRegex &re) {
+    std::vector<char> expr(pattern.begin(), pattern.end());
+    expr.push_back('\0');
+
+    TRTree ast;
+    if (!parseRegex(expr.data(), ast))
+        return false;
+    simplifyRegex(ast, keepCaptures);
+
+    re.pattern = pattern;
+    re.keepCaptures = keepCaptures;
+    re.prog = genCode(genLCode(ast));
+    optimizeCode(re.prog, keepCaptures);
+    re.lits = extractLiterals(ast);
+
+    // the engines which are built from the program or from the tree, so
+    // that a cached regex is never parsed
+    TRTree rast = ast;
+    reverseRegex(rast);
+    re.reverse = genCode(genLCode(rast));
+    optimizeCode(re.reverse, false);
+    re.dense.build(re.prog);
+    re.glushkov.build(ast);
+    return true;
+}
+
+// return true if some "match" is reachable from 0, where every target of
+// code is in range
+static bool reachesMatch(const std::vector<Inst> &code) {
+    std::vector<bool> visited(code.size(), false);
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (visited[pc])
+            continue;
+        visited[pc] = true;
+
+        Inst c = code[pc];
+        switch (OPCODE(c)) {
+        case OPMATCH:
+            return true;
+        case OPJMP:
+            stack.push_back(OPX(c));
+            break;
+        case OPSPLIT:
+            stack.push_back(OPX(c));
+            stack.push_back(OPY(c));
+            break;
+        case OPREPEAT:
+            stack.push_back(OPY(c));
+            stack.push_back(pc + 1);
+            break;
+        default:
+            // "char", "class" and "save"
+            stack.push_back(pc + 1);
+            break;
+        }
+    }
+    return false;
+}
+
+bool validateCode(const Program &prog) {
+    const std::vector<Inst> &code = prog.code;
+    if (code.empty() || code.size() > MAX_ADDR || prog.numCaptures == 0 ||
+        prog.numCaptures > MAX_ADDR / 2)
+        return false;
+
+    for (uint32_t pc = 0; pc < code.size(); pc++) {
+        Inst c = code[pc];
+
+        // the bits between the opcode and x are unused
+        if (((c >> 48) & 0xff) != 0)
+            return false;
+
+        // "char", "class", "save" and "repeat" go on to PC+1, which must
+        // be an instruction
+        bool last = pc + 1 == code.size();
+
+        switch (OPCODE(c)) {
+        case OPCHAR:
+            if (OPX(c) > 255 || last)
+                return false;
+            break;
+        case OPMATCH:
+            // the patterns of a RegexSet are not cached
+            if (OPX(c) != 0 || OPY(c) != 0)
+                return false;
+            break;
+        case OPCLASS:
+            if (OPX(c) >= prog.classes.size() || last)
+                return false;
+            break;
+        case OPSAVE:
+            if (OPX(c) >= 2 * prog.numCaptures || last)
+                return false;
+            break;
+        case OPREPEAT:
+            if (OPX(c) >= prog.counters.size() || OPY(c) >= code.size() ||
+                last)
+                return false;
+            break;
+        case OPJMP:
+            if (OPX(c) >= code.size())
+                return false;
+            break;
+        case OPSPLIT:
+            if (OPX(c) >= code.size() || OPY(c) >= code.size())
+                return false;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    for (auto &r : prog.counters) {
+        if (r.max < r.min || r.max == 0)
+            return false;
+    }
+
+    return reachesMatch(code);
+}
+
+// key of the map of the cache
+static std::string makeKey(const std::string &pattern, bool keepCaptures) {
+    return std::string(1, keepCaptures ? '1' : '0') + pattern;
+}
+
+// approximate memory used by a cached regex
+static size_t sizeOf(const CompiledRegex &re) {
+    size_t prefixes = 0;
+    for (auto &s : re.lits.prefixes)
+        prefixes += sizeof(std::string) + s.size();
+    return sizeof(CompiledRegex) + re.pattern.size() +
+           re.prog.code.size() * sizeof(Inst) +
+           re.prog.classes.size() * sizeof(ByteSet) +
+           re.prog.counters.size() * sizeof(Repeat) + re.lits.prefix.size() +
+           re.lits.inner.size() + prefixes +
+           re.reverse.code.size() * sizeof(Inst) +
+           re.reverse.classes.size() * sizeof(ByteSet) +
+           re.reverse.counters.size() * sizeof(Repeat) + re.dense.bytes() +
+           re.glushkov.bytes();
+}
+
+RegexCache::RegexCache(size_t limit)
+    : m_limit(limit), m_bytes(0), m_hits(0), m_misses(0) {}
+
+std::shared_ptr<const CompiledRegex>
+RegexCache::get(const std::string &pattern, bool keepCaptures) {
+    auto it = m_map.find(makeKey(pattern, keepCaptures));
+    if (it != m_map.end()) {
+        // move to the front
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        m_hits++;
+        return *it->second;
+    }
+
+    m_misses++;
+
+    std::shared_ptr<CompiledRegex> re(new CompiledRegex);
+    if (!compilePattern(pattern, keepCaptures, *re))
+        return nullptr;
+
+    insert(re);
+    return re;
+}
+
+void RegexCache::insert(const Entry &re) {
+    auto key = makeKey(re->pattern, re->keepCaptures);
+    auto it = m_map.find(key);
+    if (it != m_map.end()) {
+        m_bytes -= sizeOf(**it->second);
+        m_lru.erase(it->second);
+    }
+
+    m_lru.push_front(re);
+    m_map[key] = m_lru.begin();
+    m_bytes += sizeOf(*re);
+
+    evict();
+}
+
+// evict the least recently used regexes, but never the most recent one
+void RegexCache::evict() {
+    while (m_bytes > m_limit && m_lru.size() > 1) {
+        auto &re = m_lru.back();
+        m_bytes -= sizeOf(*re);
+        m_map.erase(makeKey(re->pattern, re->keepCaptures));
+        m_lru.pop_back();
+    }
+}
+
+static void putSection(std::string &buf, uint32_t tag,
+                       const std::string &data) {
+    putU32(buf, tag);
+    putU32(buf, data.size());
+    buf += data;
+}
+
+bool RegexCache::save(const char *path) const {
+    std::string buf(CACHE_MAGIC);
+    putU32(buf, CACHE_VERSION);
+    putU32(buf, m_lru.size());
+
+    // the least recently used first, so that load keeps the order
+    for (auto it = m_lru.rbegin(); it != m_lru.rend(); ++it) {
+        const CompiledRegex &re = **it;
+        std::string entry, data;
+
+        data.assign(1, (char)re.keepCaptures);
+        data += re.pattern;
+        putSection(entry, SEC_PATTERN, data);
+
+        data.assign((const char *)re.prog.code.data(),
+                    re.prog.code.size() * sizeof(Inst));
+        putSection(entry, SEC_CODE, data);
+
+        data.assign((const char *)re.prog.classes.data(),
+                    re.prog.classes.size() * sizeof(ByteSet));
+        putSection(entry, SEC_CLASSES, data);
+
+        data.assign((const char *)re.prog.counters.data(),
+                    re.prog.counters.size() * sizeof(Repeat));
+        putSection(entry, SEC_COUNTERS, data);
+
+        data.clear();
+        putU32(data, re.prog.numCaptures);
+        putSection(entry, SEC_CAPTURES, data);
+
+        data.assign(1, (char)re.lits.exact);
+        putU32(data, re.lits.prefix.size());
+        data += re.lits.prefix;
+        data += re.lits.inner;
+        putSection(entry, SEC_LITERALS, data);
+
+        data.assign(1, (char)re.lits.prefixesExact);
+        for (auto &s : re.lits.prefixes) {
+            putU32(data, s.size());
+            data += s;
+        }
+        putSection(entry, SEC_PREFIXES, data);
+
+        data.clear();
+        putU32(data, re.reverse.numCaptures);
+        putArray(data, re.reverse.code);
+        putArray(data, re.reverse.classes);
+        putArray(data, re.reverse.counters);
+        putSection(entry, SEC_REVERSE, data);
+
+        if (!re.dense.empty()) {
+            data.clear();
+            re.dense.save(data);
+            putSection(entry, SEC_DENSE, data);
+        }
+
+        if (!re.glushkov.empty()) {
+            data.clear();
+            re.glushkov.save(data);
+            putSection(entry, SEC_GLUSHKOV, data);
+        }
+
+        putU32(buf, entry.size());
+        buf += entry;
+    }
+
+    // write to a temporary file, and rename it to replace path atomically
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (fp == nullptr)
+        return false;
+
+    bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// parse the sections of an entry
+static bool loadEntry(Reader r, CompiledRegex &re) {
+    bool hasPattern = false, hasCode = false, hasLiterals = false;
+    bool hasReverse = false;
+    re.prog.numCaptures = 0; // invalid without SEC_CAPTURES
+    re.lits.prefixesExact = false;
+
+    while (r.p < r.end) {
+        uint32_t tag, size;
+        const char *data;
+        if (!r.getU32(tag) || !r.getU32(size) || !r.getBytes(data, size))
+            return false;
+
+        Reader s = {data, data + size};
+        switch (tag) {
+        case SEC_PATTERN:
+            if (s.p == s.end)
+                return false;
+            re.keepCaptures = *s.p++;
+            re.pattern.assign(s.p, s.end);
+            hasPattern = true;
+            break;
+        case SEC_CODE:
+            if (size % sizeof(Inst) != 0)
+                return false;
+            re.prog.code.resize(size / sizeof(Inst));
+            if (size != 0)
+                memcpy(re.prog.code.data(), data, size);
+            hasCode = true;
+            break;
+        case SEC_CLASSES:
+            if (size % sizeof(ByteSet) != 0)
+                return false;
+            re.prog.classes.resize(size / sizeof(ByteSet));
+            if (size != 0)
+                memcpy(re.prog.classes.data(), data, size);
+            break;
+        case SEC_COUNTERS:
+            if (size % sizeof(Repeat) != 0)
+                return false;
+            re.prog.counters.resize(size / sizeof(Repeat));
+            if (size != 0)
+                memcpy(re.prog.counters.data(), data, size);
+            break;
+        case SEC_CAPTURES:
+            if (!s.getU32(re.prog.numCaptures))
+                return false;
+            break;
+        case SEC_LITERALS: {
+            uint32_t n;
+            const char *prefix;
+            if (s.p == s.end)
+                return false;
+            re.lits.exact = *s.p++;
+            if (!s.getU32(n) || !s.getBytes(prefix, n))
+                return false;
+            re.lits.prefix.assign(prefix, n);
+            re.lits.inner.assign(s.p, s.end);
+            hasLiterals = true;
+            break;
+        }
+        case SEC_PREFIXES: {
+            if (s.p == s.end)
+                return false;
+            re.lits.prefixesExact = *s.p++;
+            re.lits.prefixes.clear();
+            while (s.p < s.end) {
+                uint32_t n;
+                const char *prefix;
+                if (!s.getU32(n) || !s.getBytes(prefix, n) ||
+                    re.lits.prefixes.size() >= MAX_PREFIXES)
+                    return false;
+                re.lits.prefixes.push_back(std::string(prefix, n));
+            }
+            break;
+        }
+        case SEC_REVERSE:
+            if (!s.getU32(re.reverse.numCaptures) ||
+                !s.getArray(re.reverse.code) ||
+                !s.getArray(re.reverse.classes) ||
+                !s.getArray(re.reverse.counters) || s.p != s.end)
+                return false;
+            hasReverse = true;
+            break;
+        case SEC_DENSE:
+            if (!re.dense.load(data, size))
+                return false;
+            break;
+        case SEC_GLUSHKOV:
+            if (!re.glushkov.load(data, size))
+                return false;
+            break;
+        default:
+            // unknown section
+            break;
+        }
+    }
+
+    if (!hasPattern || !hasCode || !hasLiterals || !hasReverse ||
+        !validateCode(re.prog) || !validateCode(re.reverse))
+        return false;
+
+    // byte classes are cheap to compute, so they are not saved
+    computeByteClasses(re.prog);
+    computeByteClasses(re.reverse);
+    return true;
+}
+
+bool RegexCache::load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t len = st.st_size;
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    Reader r = {(const char *)addr, (const char *)addr + len};
+    const char *magic;
+    uint32_t version, count;
+    bool ok = r.getBytes(magic, 4) && memcmp(magic, CACHE_MAGIC, 4) == 0 &&
+              r.getU32(version) && version == CACHE_VERSION &&
+              r.getU32(count);
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint32_t size;
+        const char *data;
+        ok = r.getU32(size) && r.getBytes(data, size);
+        if (!ok)
+            break;
+
+        std::shared_ptr<CompiledRegex> re(new CompiledRegex);
+        Reader e = {data, data + size};
+        ok = loadEntry(e, *re);
+        if (ok)
+            insert(re);
+    }
+
+    munmap(addr, len);
+    return ok;
+}
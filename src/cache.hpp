@@ -0,0 +1,76 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "codegen.hpp"
+#include "dense.hpp"
+#include "glushkov.hpp"
+#include "literal.hpp"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// a regex compiled to code, with everything the matching engines need, so
+// that it can be used without the AST
+struct CompiledRegex {
+    std::string pattern;
+    bool keepCaptures; // the groups are kept, as with "-o"
+    Program prog;
+    Literals lits;
+    Program reverse;   // of the reversed regex, for MatchFinder
+    DenseDFA dense;    // empty if it has too many transitions
+    Glushkov glushkov; // empty if it has too many positions
+};
+
+// parse and compile pattern
+// keepCaptures: passed to simplifyRegex and optimizeCode
+// return false if pattern is invalid
+bool compilePattern(const std::string &pattern, bool keepCaptures,
+                    CompiledRegex &re);
+
+// return false if prog has an unknown opcode, an address, a class or a
+// capture slot out of range, an instruction which goes on past the last
+// one, or no reachable "match"
+bool validateCode(const Program &prog);
+
+// cache of compiled regexes keyed by pattern and keepCaptures
+// the least recently used regexes are evicted when the total size exceeds
+// the limit, and the cache can be saved to a file and loaded at startup
+class RegexCache {
+  public:
+    // limit: upper bound of the total size of the cached regexes in bytes
+    RegexCache(size_t limit = 64 << 20);
+
+    // return the compiled regex of pattern, compiling it on a miss
+    // return nullptr if pattern is invalid
+    std::shared_ptr<const CompiledRegex> get(const std::string &pattern,
+                                             bool keepCaptures = false);
+
+    // save every cached regex to path, and load them back
+    // load returns false if path does not exist or is not a valid cache
+    bool save(const char *path) const;
+    bool load(const char *path);
+
+    size_t size() const { return m_lru.size(); }
+    size_t bytes() const { return m_bytes; }
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+  private:
+    typedef std::shared_ptr<const CompiledRegex> Entry;
+
+    void insert(const Entry &re);
+    void evict();
+
+    // most recently used first
+    std::list<Entry> m_lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_map;
+
+    size_t m_limit;
+    size_t m_bytes;
+    size_t m_hits;
+    size_t m_misses;
+};
+
+#endif // CACHE_HPP
@@ -1,171 +1,319 @@
 #include "codegen.hpp"
 #include "parser.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
-#include <map>
+#include <utility>
 #include <vector>
 
-static uint8_t label;
+// address of a label which is not yet bound
+#define UNBOUND ((uint32_t)-1)
 
-static std::vector<LCode> genLCode(TRBase *expr, std::set<uint8_t> &nlabel);
+static void genLCode(const TRTree &tree, TRIndex n, LCode &lc);
 
-static uint8_t nextLabel() {
-    assert(label < 128);
-    return label++;
+static uint32_t nextLabel(LCode &lc) {
+    assert(lc.labels.size() <= MAX_ADDR);
+    lc.labels.push_back(UNBOUND);
+    return lc.labels.size() - 1;
 }
 
-// append v2 to v1
-// ex:
-//   input:
-//     v1 = [1, 2]
-//     v2 = [3, 4, 5]
-//   output:
-//     v1 = [1, 2, 3, 4, 5]
-//     v2 = [3, 4, 5] // not modified
-static void appendLCode(std::vector<LCode> &v1, const std::vector<LCode> &v2) {
-    v1.insert(v1.end(), v2.begin(), v2.end());
+// bind the label L to the address of the next code
+static void bindLabel(LCode &lc, uint32_t L) {
+    assert(lc.code.size() <= MAX_ADDR);
+    lc.labels[L] = lc.code.size();
 }
 
+static void emit(LCode &lc, Inst inst) { lc.code.push_back(inst); }
+
 // generete labeled code for "char"
-static std::vector<LCode> genLChar(TRChar *e) {
-    std::vector<LCode> ret;
-    LCode c;
+static void genLChar(const TRNode &e, LCode &lc) {
+    emit(lc, INST(OPCHAR, (uint8_t)e.c, 0)); // machine code of "char"
+}
 
-    c.code = (uint16_t)e->c; // machine code of "char"
-    ret.push_back(c);
+// generete labeled code for a string, a "char" for every byte
+static void genLString(const TRTree &tree, TRIndex n, LCode &lc) {
+    for (char c : tree.string(n))
+        emit(lc, INST(OPCHAR, (uint8_t)c, 0));
+}
 
-    return ret;
+// generete labeled code for a set of bytes
+static void genLClass(const TRTree &tree, const TRNode &e, LCode &lc) {
+    const ByteSet &set = tree.classes[e.left];
+
+    // a set of a byte is just a "char"
+    if (set.count() == 1) {
+        for (int c = 0; c < 256; c++) {
+            if (set.test(c)) {
+                emit(lc, INST(OPCHAR, c, 0));
+                return;
+            }
+        }
+    }
+
+    // share the same sets
+    uint32_t n = 0;
+    while (n < lc.classes.size() && !(lc.classes[n] == set))
+        n++;
+    if (n == lc.classes.size()) {
+        assert(n <= MAX_ADDR);
+        lc.classes.push_back(set);
+    }
+
+    emit(lc, INST(OPCLASS, n, 0)); // machine code of "class"
 }
 
 // generate labeled code for "match"
-static std::vector<LCode> genLMatch() {
-    std::vector<LCode> ret;
-    LCode c;
+static void genLMatch(LCode &lc) { emit(lc, INST(OPMATCH, 0, 0)); }
+
+// generate labeled code for expressions
+static void genLExprs(const TRTree &tree, TRIndex n, LCode &lc) {
+    for (uint32_t i = 0; i < tree[n].right; i++)
+        genLCode(tree, tree.child(n, i), lc); // concatenate
+}
+
+// generete labeled code for "?"
+//       split L1, L2
+//   L1: codes for e
+//   L2:
+static void genLQuestion(const TRTree &tree, const TRNode &e, LCode &lc) {
+    // generate labels for split
+    uint32_t L1 = nextLabel(lc), L2 = nextLabel(lc);
 
-    c.code = OPMATCH;
-    ret.push_back(c);
+    // split L1, L2
+    emit(lc, INST(OPSPLIT, L1, L2));
 
-    return ret;
+    // L1: codes for e
+    bindLabel(lc, L1);
+    genLCode(tree, e.left, lc);
+
+    // L2:
+    bindLabel(lc, L2);
 }
 
-// generate labeled code for expressions
-static std::vector<LCode> genLExprs(TRExprs *e, std::set<uint8_t> &nlabel) {
-    std::vector<LCode> ret;
-    std::set<uint8_t> labels;
+// generete labeled code for "+"
+//   L1: codes for e
+//       split L1, L2
+//   L2:
+static void genLPlus(const TRTree &tree, const TRNode &e, LCode &lc) {
+    // generate labels for split
+    uint32_t L1 = nextLabel(lc), L2 = nextLabel(lc);
+
+    // L1: codes for e
+    bindLabel(lc, L1);
+    genLCode(tree, e.left, lc);
 
-    for (auto &p : e->exprs) {
-        std::set<uint8_t> nl;
-        auto lc = genLCode(p, nl);
-        assert(!lc.empty());
+    // split L1, L2
+    emit(lc, INST(OPSPLIT, L1, L2));
 
-        // add the labels
-        lc[0].label.insert(labels.begin(), labels.end());
+    // L2:
+    bindLabel(lc, L2);
+}
 
-        labels = nl;
+// generete labeled code for "*"
+//   L1: split L2, L3
+//   L2: codes for e
+//       jmp L1
+//   L3:
+static void genLStar(const TRTree &tree, const TRNode &e, LCode &lc) {
+    // generate labels for split and jmp
+    uint32_t L1 = nextLabel(lc), L2 = nextLabel(lc), L3 = nextLabel(lc);
 
-        appendLCode(ret, lc); // concatenate
-    }
+    // L1: split L2, L3
+    bindLabel(lc, L1);
+    emit(lc, INST(OPSPLIT, L2, L3));
 
-    nlabel = labels;
+    // L2: codes for e
+    bindLabel(lc, L2);
+    genLCode(tree, e.left, lc);
 
-    return ret;
+    // jmp L1
+    emit(lc, INST(OPJMP, L1, 0));
+
+    // L3:
+    bindLabel(lc, L3);
 }
 
-// generete labeled code for "?"
-// return:
-//       split L1, L2
+// generete labeled code for "{min,max}"
+// the body is emitted once whatever the bounds are, and a counter of the
+// iterations decides whether to loop
+//       split L1, L2 (only if min is 0)
 //   L1: codes for e
+//       repeat r, L1
 //   L2:
-// output:
-//   nlabel = {L2}
-static std::vector<LCode> genLQuestion(TRQuestion *e,
-                                       std::set<uint8_t> &nlabel) {
-    std::vector<LCode> ret;
+static void genLRepeat(const TRTree &tree, const TRNode &e, LCode &lc) {
+    const Repeat &r = tree.repeats[e.right];
+
+    // bounds which need no counter
+    if (r.max == 0)
+        return;
+    if (r.min == 1 && r.max == 1) {
+        genLCode(tree, e.left, lc);
+        return;
+    }
+    if (r.min == 0 && r.max == 1) {
+        genLQuestion(tree, e, lc);
+        return;
+    }
+    if (r.min == 0 && r.max == REPEAT_INF) {
+        genLStar(tree, e, lc);
+        return;
+    }
+    if (r.min == 1 && r.max == REPEAT_INF) {
+        genLPlus(tree, e, lc);
+        return;
+    }
 
-    // generate labels for split
-    uint8_t L1 = nextLabel(), L2 = nextLabel();
+    // generate labels for split and repeat
+    uint32_t L1 = nextLabel(lc), L2 = nextLabel(lc);
 
-    // split L1, L2
-    LCode split;
-    split.code = OPSPLIT | L1 << 7 | L2; // machine code of split
+    assert(lc.counters.size() < MAX_ADDR);
+    uint32_t counter = lc.counters.size();
+    lc.counters.push_back(r);
 
-    ret.push_back(split); // append "split" to the last
+    // split L1, L2
+    if (r.min == 0)
+        emit(lc, INST(OPSPLIT, L1, L2));
 
     // L1: codes for e
-    auto lc = genLCode(e->expr, nlabel);
-    assert(!lc.empty());
-    lc[0].label.insert(L1);
+    bindLabel(lc, L1);
+    genLCode(tree, e.left, lc);
 
-    appendLCode(ret, lc);
+    // repeat r, L1
+    emit(lc, INST(OPREPEAT, counter, L1));
 
     // L2:
-    nlabel.insert(L2); // a label of the next code
+    bindLabel(lc, L2);
+}
 
-    return ret;
+// generete labeled code for a capture group
+//       save 2n
+//       codes for e
+//       save 2n + 1
+static void genLCapture(const TRTree &tree, const TRNode &e, LCode &lc) {
+    assert(2 * e.right + 1 <= MAX_ADDR);
+    emit(lc, INST(OPSAVE, 2 * e.right, 0));
+    genLCode(tree, e.left, lc);
+    emit(lc, INST(OPSAVE, 2 * e.right + 1, 0));
+}
+
+// generete labeled code for "|"
+//       split L1, L2
+//   L1: codes for left
+//       jmp L3
+//   L2: codes for right
+//   L3:
+static void genLOr(const TRTree &tree, const TRNode &e, LCode &lc) {
+    // generate labels for split and jmp
+    uint32_t L1 = nextLabel(lc), L2 = nextLabel(lc), L3 = nextLabel(lc);
+
+    // split L1, L2
+    emit(lc, INST(OPSPLIT, L1, L2));
+
+    // L1: codes for left
+    bindLabel(lc, L1);
+    genLCode(tree, e.left, lc);
+
+    // jmp L3
+    emit(lc, INST(OPJMP, L3, 0));
+
+    // L2: codes for right
+    bindLabel(lc, L2);
+    genLCode(tree, e.right, lc);
+
+    // L3:
+    bindLabel(lc, L3);
 }
 
 // generate labeled code
-static std::vector<LCode> genLCode(TRBase *expr, std::set<uint8_t> &nlabel) {
-    if (typeid(*expr) == typeid(TRExprs)) {
-        auto *e = dynamic_cast<TRExprs *>(expr);
-        return genLExprs(e, nlabel);
-    } else if (typeid(*expr) == typeid(TRChar)) {
-        auto *e = dynamic_cast<TRChar *>(expr);
-        return genLChar(e);
-    } else if (typeid(*expr) == typeid(TRQuestion)) {
-        auto *e = dynamic_cast<TRQuestion *>(expr);
-        return genLQuestion(e, nlabel);
-    } else if (typeid(*expr) == typeid(TRMatch)) {
-        return genLMatch();
-    } else if (typeid(*expr) == typeid(TRPlus)) {
-        // implement here
-    } else if (typeid(*expr) == typeid(TRStar)) {
-        // implement here
-    } else if (typeid(*expr) == typeid(TROr)) {
-        // implement here
+// codes are appended to lc.code, and a label is bound to the address of the
+// code which follows it as soon as the code is known, so this takes linear
+// time in the size of the code
+static void genLCode(const TRTree &tree, TRIndex n, LCode &lc) {
+    const TRNode &e = tree[n];
+    switch (e.kind) {
+    case TR_EXPRS:
+        genLExprs(tree, n, lc);
+        return;
+    case TR_CHAR:
+        genLChar(e, lc);
+        return;
+    case TR_QUESTION:
+        genLQuestion(tree, e, lc);
+        return;
+    case TR_MATCH:
+        genLMatch(lc);
+        return;
+    case TR_PLUS:
+        genLPlus(tree, e, lc);
+        return;
+    case TR_STAR:
+        genLStar(tree, e, lc);
+        return;
+    case TR_OR:
+        genLOr(tree, e, lc);
+        return;
+    case TR_CLASS:
+        genLClass(tree, e, lc);
+        return;
+    case TR_REPEAT:
+        genLRepeat(tree, e, lc);
+        return;
+    case TR_CAPTURE:
+        genLCapture(tree, e, lc);
+        return;
+    case TR_STRING:
+        genLString(tree, n, lc);
+        return;
     }
 
     assert(false); // never reach here if every operation is implemented
-    return std::vector<LCode>();
 }
 
-std::vector<LCode> genLCode(TRBase *expr) {
-    std::set<uint8_t> labels;
-    return genLCode(expr, labels);
+LCode genLCode(const TRTree &tree) {
+    LCode lc;
+    lc.numCaptures = 1 + tree.numGroups;
+    genLCode(tree, tree.root, lc);
+    return lc;
 }
 
 // generate code from labeled code
-std::vector<uint16_t> genCode(const std::vector<LCode> &lc) {
-    std::vector<uint16_t> ret;
-    std::map<uint8_t, uint8_t> label2addr;
-
-    // make a map from labels to addresses
-    for (int i = 0; i < lc.size(); i++) {
-        for (auto &label : lc[i].label) {
-            label2addr[label] = i;
-        }
-    }
-
-    for (auto &c : lc) {
-        switch (c.code & (3 << 14)) {
+Program genCode(const LCode &lc) {
+    Program ret;
+    ret.code.reserve(lc.code.size());
+    ret.classes = lc.classes;
+    ret.counters = lc.counters;
+    ret.numCaptures = lc.numCaptures;
+
+    for (auto c : lc.code) {
+        switch (OPCODE(c)) {
         case OPMATCH:
         case OPCHAR:
-            // "match" and "char" do not require translation
-            ret.push_back(c.code);
+        case OPCLASS:
+        case OPSAVE:
+            // "match", "char", "class" and "save" do not require translation
+            ret.code.push_back(c);
             break;
         case OPJMP: {
             // translate the label to corresponding address
-            uint16_t addr = c.code & 0x03fff;
-            addr = label2addr[addr];
-            ret.push_back(OPJMP | addr);
+            uint32_t addr = lc.labels[OPX(c)];
+            assert(addr != UNBOUND);
+            ret.code.push_back(INST(OPJMP, addr, 0));
             break;
         }
         case OPSPLIT: {
+            // translate the labels to corresponding addresses
+            uint32_t addr1 = lc.labels[OPX(c)], addr2 = lc.labels[OPY(c)];
+            assert(addr1 != UNBOUND && addr2 != UNBOUND);
+            ret.code.push_back(INST(OPSPLIT, addr1, addr2));
+            break;
+        }
+        case OPREPEAT: {
             // translate the label to corresponding address
-
-            // implement here
-
+            uint32_t addr = lc.labels[OPY(c)];
+            assert(addr != UNBOUND);
+            ret.code.push_back(INST(OPREPEAT, OPX(c), addr));
             break;
         }
         default:
@@ -174,39 +322,106 @@ std::vector<uint16_t> genCode(const std::vector<LCode> &lc) {
         }
     }
 
+    computeByteClasses(ret);
+
     return ret;
 }
 
+// split every byte class by a set of bytes
+// cls is refined so that no class has bytes both in and out of set
+static void refineByteClasses(uint8_t *cls, uint32_t &n, const ByteSet &set) {
+    // new class of the bytes in set for every old class, or 256 if unseen
+    uint16_t in[256], out[256];
+    for (uint32_t k = 0; k < n; k++)
+        in[k] = out[k] = 256;
+
+    uint32_t m = 0;
+    for (int c = 0; c < 256; c++) {
+        uint16_t *map = set.test(c) ? in : out;
+        if (map[cls[c]] == 256)
+            map[cls[c]] = m++;
+        cls[c] = map[cls[c]];
+    }
+    n = m;
+}
+
+// compute byte equivalence classes from the bytes of "char" and the sets of
+// "class"
+void computeByteClasses(Program &prog) {
+    uint8_t cls[256] = {0};
+    uint32_t n = 1;
+
+    ByteSet chars;
+    for (auto c : prog.code) {
+        if (OPCODE(c) == OPCHAR && !chars.test(OPX(c))) {
+            chars.add(OPX(c));
+            ByteSet set;
+            set.add(OPX(c));
+            refineByteClasses(cls, n, set);
+        }
+    }
+
+    for (auto &set : prog.classes)
+        refineByteClasses(cls, n, set);
+
+    memcpy(prog.byteClass, cls, sizeof(cls));
+    prog.numByteClasses = n;
+}
+
 // print labeled code
-void printLCode(const std::vector<LCode> &code) {
-    for (auto &c : code) {
+void printLCode(const LCode &lc) {
+    // pairs of (address, label), sorted by address
+    std::vector<std::pair<uint32_t, uint32_t>> addr2label;
+    for (uint32_t L = 0; L < lc.labels.size(); L++)
+        addr2label.push_back(std::make_pair(lc.labels[L], L));
+    std::sort(addr2label.begin(), addr2label.end());
+
+    auto it = addr2label.begin();
+    for (uint32_t addr = 0; addr < lc.code.size(); addr++) {
         int n = 0;
-        for (auto &L : c.label) {
+        for (; it != addr2label.end() && it->first == addr; ++it) {
             if (n > 0)
                 std::cout << ", ";
-            std::cout << "L" << (uint32_t)L;
+            std::cout << "L" << it->second;
             n++;
         }
         if (n > 0)
             std::cout << ":\n";
 
-        switch (c.code & (3 << 14)) {
+        Inst c = lc.code[addr];
+        switch (OPCODE(c)) {
         case OPMATCH:
-            std::cout << "  match" << std::endl;
+            std::cout << "  match";
+            if (OPX(c) != 0)
+                std::cout << " " << OPX(c);
+            std::cout << std::endl;
             break;
         case OPCHAR: {
-            std::cout << "  char " << (char)c.code << std::endl;
+            std::cout << "  char " << byteString(OPX(c)) << std::endl;
+            break;
+        }
+        case OPCLASS: {
+            std::cout << "  class " << byteSetString(lc.classes[OPX(c)])
+                      << std::endl;
             break;
         }
         case OPSPLIT: {
-            uint8_t L1 = c.code >> 7, L2 = c.code & 0x007f;
-            std::cout << "  split L" << (uint32_t)L1 << ", L" << (uint32_t)L2
+            std::cout << "  split L" << OPX(c) << ", L" << OPY(c)
                       << std::endl;
             break;
         }
         case OPJMP: {
-            uint16_t L = c.code & 0x3fff;
-            std::cout << "  jmp L" << L << std::endl;
+            std::cout << "  jmp L" << OPX(c) << std::endl;
+            break;
+        }
+        case OPREPEAT: {
+            std::cout << "  repeat " << OPX(c)
+                      << repeatString(lc.counters[OPX(c)]) << ", L" << OPY(c)
+                      << std::endl;
+            break;
+        }
+        case OPSAVE: {
+            std::cout << "  save " << OPX(c) << std::endl;
             break;
         }
         default:
@@ -229,30 +444,48 @@ static void printDigit4(int n) {
 }
 
 // print code
-void printCode(const std::vector<uint16_t> &code) {
+void printCode(const Program &prog) {
     int n = 0;
-    for (auto &c : code) {
-        switch (c & (3 << 14)) {
+    for (auto &c : prog.code) {
+        switch (OPCODE(c)) {
         case OPMATCH:
             printDigit4(n);
-            std::cout << "  match" << std::endl;
+            std::cout << "  match";
+            if (OPX(c) != 0)
+                std::cout << " " << OPX(c);
+            std::cout << std::endl;
             break;
         case OPCHAR: {
             printDigit4(n);
-            std::cout << "  char " << (char)c << std::endl;
+            std::cout << "  char " << byteString(OPX(c)) << std::endl;
             break;
         }
-        case OPSPLIT: {
-            uint8_t L1 = c >> 7, L2 = c & 0x007f;
+        case OPCLASS: {
             printDigit4(n);
-            std::cout << "  split " << (uint32_t)L1 << ", " << (uint32_t)L2
+            std::cout << "  class " << byteSetString(prog.classes[OPX(c)])
                       << std::endl;
             break;
         }
+        case OPSPLIT: {
+            printDigit4(n);
+            std::cout << "  split " << OPX(c) << ", " << OPY(c) << std::endl;
+            break;
+        }
         case OPJMP: {
-            uint16_t L = c & 0x3fff;
             printDigit4(n);
-            std::cout << "  jmp L" << L << std::endl;
+            std::cout << "  jmp " << OPX(c) << std::endl;
+            break;
+        }
+        case OPREPEAT: {
+            printDigit4(n);
+            std::cout << "  repeat " << OPX(c)
+                      << repeatString(prog.counters[OPX(c)]) << ", " << OPY(c)
+                      << std::endl;
+            break;
+        }
+        case OPSAVE: {
+            printDigit4(n);
+            std::cout << "  save " << OPX(c) << std::endl;
             break;
         }
         default:
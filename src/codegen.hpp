@@ -3,22 +3,73 @@
 
 #include "parser.hpp"
 
-#include <set>
+#include <cstdint>
+#include <vector>
+
+// machine code
+// an instruction is a 64-bit word of an 8-bit opcode and two 24-bit
+// operands, x and y:
+//   char c:     x = c
+//   jmp x:      jump to x
+//   split x, y: clone (one thread's PC = x, and another's PC = y)
+//   match x:    found the pattern x, which is 0 but in a RegexSet
+//   class x:    if the character is in classes[x] then PC++, else fail
+//   repeat x, y: count an iteration of the loop of the counter x, and jump
+//               to y while the count is below counters[x].min, PC++ when it
+//               reaches counters[x].max, otherwise clone like "split y, PC+1"
+//               (the counter is reset to 0 on PC++)
+//   save x:     store the current position to the capture slot x, PC++
+typedef uint64_t Inst;
 
 #define OPCHAR 0
-#define OPJMP (1 << 14)
-#define OPSPLIT (2 << 14)
-#define OPMATCH (3 << 14)
+#define OPJMP 1
+#define OPSPLIT 2
+#define OPMATCH 3
+#define OPCLASS 4
+#define OPREPEAT 5
+#define OPSAVE 6
+
+#define INST(op, x, y)                                                         \
+    (((Inst)(op) << 56) | ((Inst)(x) << 24) | (Inst)(y))
+#define OPCODE(inst) ((uint8_t)((inst) >> 56))
+#define OPX(inst) ((uint32_t)((inst) >> 24) & 0xffffff)
+#define OPY(inst) ((uint32_t)(inst)&0xffffff)
+
+// upper bound of addresses and labels
+#define MAX_ADDR 0xffffff
 
 // labeled machine code for regular expression
+// the operands of "jmp" and "split", and y of "repeat", are labels, and
+// labels[L] is the address of the label L
 struct LCode {
-    std::set<uint8_t> label;
-    uint16_t code;
+    std::vector<Inst> code;
+    std::vector<uint32_t> labels;
+    std::vector<ByteSet> classes;
+    std::vector<Repeat> counters;
+    uint32_t numCaptures;
+};
+
+// machine code for regular expression
+struct Program {
+    std::vector<Inst> code;
+    std::vector<ByteSet> classes; // the sets of bytes of "class"
+    std::vector<Repeat> counters; // the bounds of the counters of "repeat"
+
+    // number of capture groups, including the whole match as the group 0
+    // the group i is saved to the slots 2 * i and 2 * i + 1 by "save"
+    uint32_t numCaptures;
+
+    // byte equivalence classes
+    // no instruction tells apart the bytes in the same class, and the
+    // classes are numbered from 0 to numByteClasses - 1
+    uint8_t byteClass[256];
+    uint32_t numByteClasses;
 };
 
-std::vector<LCode> genLCode(TRBase *expr);
-std::vector<uint16_t> genCode(const std::vector<LCode> &lc);
-void printLCode(const std::vector<LCode> &code);
-void printCode(const std::vector<uint16_t> &code);
+LCode genLCode(const TRTree &tree);
+Program genCode(const LCode &lc);
+void computeByteClasses(Program &prog);
+void printLCode(const LCode &lc);
+void printCode(const Program &prog);
 
-#endif // CODEGEN_HPP
\ No newline at end of file
+#endif // CODEGEN_HPP
@@ -0,0 +1,254 @@
+#include "dense.hpp"
+#include "dfa.hpp"
+#include "serial.hpp"
+
+#include <cstring>
+
+// return the block of every state of the DFA of n states with the
+// transitions delta[s * k + c], where the states of a block are equivalent,
+// by Hopcroft's algorithm
+//
+// the blocks start as the accepting states and the others, and a block is
+// split whenever the transitions of some of its states by some byte class
+// go into a block (the splitter) and the others do not. of the two halves
+// of a split, only the smaller one needs to be a splitter later, unless the
+// block was waiting to be a splitter itself, which gives O(n k log n).
+static std::vector<uint32_t> minimize(const std::vector<uint32_t> &delta,
+                                      uint32_t n, uint32_t k,
+                                      const std::vector<bool> &accept) {
+    // the sources of the transitions to t by c are
+    // sources[first[t * k + c]..first[t * k + c + 1])
+    std::vector<uint32_t> first(n * k + 1, 0), sources(n * k);
+    for (uint32_t i = 0; i < n * k; i++)
+        first[delta[i] * k + i % k + 1]++;
+    for (uint32_t i = 0; i < n * k; i++)
+        first[i + 1] += first[i];
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (uint32_t i = 0; i < n * k; i++)
+        sources[fill[delta[i] * k + i % k]++] = i / k;
+
+    // the states of the block b are states[begin[b]..end[b]), where the
+    // first marked[b] ones are the ones marked by the current splitter,
+    // and the state s is at states[pos[s]]
+    std::vector<uint32_t> states, pos(n), block(n);
+    std::vector<uint32_t> begin, end, marked;
+    for (int a = 1; a >= 0; a--) {
+        uint32_t b = begin.size();
+        begin.push_back(states.size());
+        for (uint32_t s = 0; s < n; s++) {
+            if (accept[s] == (a == 1)) {
+                pos[s] = states.size();
+                block[s] = b;
+                states.push_back(s);
+            }
+        }
+        end.push_back(states.size());
+        marked.push_back(0);
+    }
+
+    // either initial block is a splitter for both
+    std::vector<uint32_t> work;
+    std::vector<bool> waiting(2, false);
+    uint32_t w = end[0] - begin[0] <= end[1] - begin[1] ? 0 : 1;
+    work.push_back(w);
+    waiting[w] = true;
+
+    std::vector<uint32_t> splitter, touched;
+    while (!work.empty()) {
+        uint32_t a = work.back();
+        work.pop_back();
+        waiting[a] = false;
+
+        // the splitter is the states of a before it is split by itself
+        splitter.assign(states.begin() + begin[a], states.begin() + end[a]);
+        for (uint32_t c = 0; c < k; c++) {
+            // mark the states which go into the splitter by c
+            touched.clear();
+            for (uint32_t t : splitter) {
+                for (uint32_t i = first[t * k + c]; i < first[t * k + c + 1];
+                     i++) {
+                    uint32_t s = sources[i];
+                    uint32_t b = block[s];
+                    uint32_t m = begin[b] + marked[b];
+                    if (pos[s] < m)
+                        continue;
+
+                    // swap s with the first state which is not marked
+                    uint32_t o = states[m];
+                    states[pos[s]] = o;
+                    pos[o] = pos[s];
+                    states[m] = s;
+                    pos[s] = m;
+                    if (marked[b]++ == 0)
+                        touched.push_back(b);
+                }
+            }
+
+            // the marked states of a block which has others become a block
+            for (uint32_t b : touched) {
+                uint32_t m = marked[b];
+                marked[b] = 0;
+                if (m == end[b] - begin[b])
+                    continue;
+
+                uint32_t nb = begin.size();
+                begin.push_back(begin[b]);
+                end.push_back(begin[b] + m);
+                marked.push_back(0);
+                waiting.push_back(false);
+                begin[b] += m;
+                for (uint32_t i = begin[nb]; i < end[nb]; i++)
+                    block[states[i]] = nb;
+
+                uint32_t next = nb;
+                if (!waiting[b] && end[b] - begin[b] < m)
+                    next = b;
+                work.push_back(next);
+                waiting[next] = true;
+            }
+        }
+    }
+
+    return block;
+}
+
+DenseDFA::DenseDFA() : m_stride(1), m_start(0), m_built(0) {
+    memset(m_byteClass, 0, sizeof(m_byteClass));
+}
+
+bool DenseDFA::build(const Program &prog, bool anchored) {
+    m_trans.clear();
+
+    DFA dfa(prog, DENSE_BUDGET, anchored);
+    if (!dfa.build())
+        return false;
+
+    // a byte of every byte class
+    uint32_t k = prog.numByteClasses;
+    std::vector<uint8_t> rep(k);
+    for (int b = 255; b >= 0; b--)
+        rep[prog.byteClass[b]] = b;
+
+    // the states of the lazy DFA are numbered from 2, after the dead state
+    // (0) and the match state (1), and a state with "match", which is only
+    // the start state, goes to the match state as the latter
+    uint32_t n = dfa.numStates() + 2;
+    std::vector<uint32_t> delta(n * k);
+    std::vector<bool> accept(n, false);
+    accept[1] = true;
+    for (uint32_t s = 0; s < n; s++) {
+        for (uint32_t c = 0; c < k; c++) {
+            uint32_t t = s;
+            if (s >= 2) {
+                int32_t d = dfa.transition(s - 2, rep[c]);
+                if (dfa.isMatch(s - 2) || d == DFA_MATCH)
+                    t = 1;
+                else if (d < 0)
+                    t = 0;
+                else
+                    t = d + 2;
+            }
+            delta[s * k + c] = t;
+        }
+        if (s >= 2 && dfa.isMatch(s - 2))
+            accept[s] = true;
+    }
+
+    // number the blocks from the ones of the dead and the match states,
+    // and then in the order of their first states
+    std::vector<uint32_t> block = minimize(delta, n, k, accept);
+    std::vector<uint32_t> row(n, UINT32_MAX);
+    row[block[0]] = 0;
+    row[block[1]] = 1;
+    uint32_t rows = 2;
+    for (uint32_t s = 2; s < n; s++) {
+        if (row[block[s]] == UINT32_MAX)
+            row[block[s]] = rows++;
+    }
+    if ((size_t)rows * k > DENSE_MAX_TRANSITIONS)
+        return false;
+
+    // the rows of the first states of the blocks
+    std::vector<uint16_t> trans(rows * k);
+    std::vector<bool> done(rows, false);
+    for (uint32_t s = 0; s < n; s++) {
+        uint32_t r = row[block[s]];
+        if (done[r])
+            continue;
+        done[r] = true;
+        for (uint32_t c = 0; c < k; c++)
+            trans[r * k + c] = row[block[delta[s * k + c]]] * k;
+    }
+
+    memcpy(m_byteClass, prog.byteClass, sizeof(m_byteClass));
+    m_stride = k;
+    m_trans.swap(trans);
+    m_start = row[block[dfa.start() + 2]] * k;
+    m_built = dfa.numStates();
+    return true;
+}
+
+void DenseDFA::save(std::string &data) const {
+    data.append((const char *)m_byteClass, sizeof(m_byteClass));
+    putU32(data, m_stride);
+    putU32(data, m_start);
+    putU32(data, m_built);
+    putArray(data, m_trans);
+}
+
+bool DenseDFA::load(const char *data, size_t size) {
+    Reader r = {data, data + size};
+    const char *byteClass;
+    uint32_t stride, start, built;
+    std::vector<uint16_t> trans;
+    if (!r.getBytes(byteClass, sizeof(m_byteClass)) || !r.getU32(stride) ||
+        !r.getU32(start) || !r.getU32(built) || !r.getArray(trans) ||
+        r.p != r.end)
+        return false;
+
+    // the start and every transition are rows, so match never reads out of
+    // the table, and the dead and the match rows go back to themselves
+    if (stride == 0 || stride > 256 || trans.size() % stride != 0 ||
+        trans.size() < 2 * stride || trans.size() > DENSE_MAX_TRANSITIONS ||
+        start % stride != 0 || start >= trans.size())
+        return false;
+    for (int b = 0; b < 256; b++) {
+        if ((uint8_t)byteClass[b] >= stride)
+            return false;
+    }
+    for (size_t i = 0; i < trans.size(); i++) {
+        if (trans[i] % stride != 0 || trans[i] >= trans.size())
+            return false;
+        if (i < 2 * stride && trans[i] != i / stride * stride)
+            return false;
+    }
+
+    memcpy(m_byteClass, byteClass, sizeof(m_byteClass));
+    m_stride = stride;
+    m_trans.swap(trans);
+    m_start = start;
+    m_built = built;
+    return true;
+}
+
+bool DenseDFA::match(const char *str, size_t len) const {
+    const uint16_t *trans = m_trans.data();
+    const uint8_t *byteClass = m_byteClass;
+    const uint8_t *p = (const uint8_t *)str;
+    uint32_t s = m_start;
+    uint32_t first = 2 * m_stride;
+
+    // the dead and the match states go back to themselves, so the state is
+    // checked only after every 4 bytes
+    size_t i = 0;
+    for (; s >= first && i + 4 <= len; i += 4) {
+        s = trans[s + byteClass[p[i]]];
+        s = trans[s + byteClass[p[i + 1]]];
+        s = trans[s + byteClass[p[i + 2]]];
+        s = trans[s + byteClass[p[i + 3]]];
+    }
+    for (; s >= first && i < len; i++)
+        s = trans[s + byteClass[p[i]]];
+
+    return s == m_stride;
+}
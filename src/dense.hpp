@@ -0,0 +1,78 @@
+#ifndef DENSE_HPP
+#define DENSE_HPP
+
+#include "codegen.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// upper bound of the memory used by the lazy DFA from which a dense DFA is
+// built
+#define DENSE_BUDGET (1 << 20)
+
+// upper bound of the transitions of a dense DFA, so that they are 16-bit
+// offsets, and the table is at most 128KB
+#define DENSE_MAX_TRANSITIONS (1 << 16)
+
+// fully built and minimized DFA for the small regexes
+//
+// every state of the lazy DFA (see DFA) is built, and the equivalent states
+// are merged by Hopcroft's algorithm, where the states which never reach a
+// match become the dead state. a state is a row of a transition per byte
+// class (see computeByteClasses), and a transition is the offset of the row
+// of its target, so the next state is trans[s + byteClass[c]] without a
+// multiplication. the rows of the dead state and of the match state are at
+// 0 and at numClasses, and they go back to themselves, so the scan checks
+// them only every few bytes.
+//
+// unlike the lazy DFA, a dense DFA is not changed by match, and then it is
+// shared by the threads
+class DenseDFA {
+  public:
+    DenseDFA();
+
+    // build the DFA of prog, which matches as the lazy DFA with DFA_EXISTS,
+    // and return false if it has more than DENSE_MAX_TRANSITIONS transitions
+    // anchored: if false, a match may start at any position
+    bool build(const Program &prog, bool anchored = false);
+
+    // return true if str[0..len) has a match
+    bool match(const char *str, size_t len) const;
+
+    bool empty() const { return m_trans.empty(); }
+
+    // append the tables to data for a cache file, and set them from data
+    // load returns false if data is not the tables of a dense DFA
+    void save(std::string &data) const;
+    bool load(const char *data, size_t size);
+
+    // approximate memory used by the tables
+    size_t bytes() const {
+        return sizeof(*this) + m_trans.size() * sizeof(uint16_t);
+    }
+
+    // accessors for genDFAHeader
+    // a state is the offset of its row, and the states below firstState()
+    // are the dead state (0) and the match state (numClasses())
+    uint32_t start() const { return m_start; }
+    uint32_t firstState() const { return 2 * m_stride; }
+    uint32_t numClasses() const { return m_stride; }
+    const uint8_t *byteClasses() const { return m_byteClass; }
+    const std::vector<uint16_t> &transitions() const { return m_trans; }
+
+    // the states but the dead and the match ones, after and before the
+    // minimization
+    size_t numStates() const { return m_trans.size() / m_stride - 2; }
+    size_t numBuilt() const { return m_built; }
+
+  private:
+    uint8_t m_byteClass[256];
+    uint32_t m_stride; // number of byte classes
+    std::vector<uint16_t> m_trans;
+    uint32_t m_start;
+    size_t m_built;
+};
+
+#endif // DENSE_HPP
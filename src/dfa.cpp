@@ -0,0 +1,488 @@
+#include "dfa.hpp"
+#include "eval.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// a DFA state must have been rebuilt at least once per this number of
+// scanned bytes, otherwise the cache is considered to be thrashing
+#define DFA_MIN_BYTES_PER_STATE 10
+
+// the last word of the key of a state after a match by DFA_FIRST, which
+// tells it apart from the state of the same threads before a match, and is
+// neither a PC nor a count
+#define DFA_FOUND_KEY ((uint32_t)-1)
+
+size_t DFA::Hash::operator()(const std::vector<uint32_t> &threads) const {
+    // FNV-1a
+    size_t h = 14695981039346656037ULL;
+    for (auto word : threads) {
+        h ^= word;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+DFA::DFA(const Program &prog, size_t budget, bool anchored, DFAKind kind)
+    : m_prog(prog), m_code(prog.code), m_stride(prog.numByteClasses),
+      m_rep(prog.numByteClasses), m_budget(budget), m_anchored(anchored),
+      m_kind(kind), m_mem(0), m_start(0), m_flushes(0), m_fallbacks(0),
+      m_built(0), m_misses(0), m_scanned(0), m_flushScanned(0),
+      m_list(prog.code.size(), prog.counters.size()) {
+    for (int c = 255; c >= 0; c--)
+        m_rep[prog.byteClass[c]] = c;
+
+    flush();
+    m_flushes = 0;
+}
+
+// convert the threads in m_list to the threads of a DFA state
+// "jmp", "split" and "repeat" are dropped, because addThread already
+// followed them
+void DFA::closure(std::vector<uint32_t> &threads) {
+    uint32_t w = m_list.width();
+    threads.clear();
+    for (uint32_t i = 0; i < m_list.size(); i++) {
+        const uint32_t *t = m_list[i];
+        switch (OPCODE(m_code[t[0]])) {
+        case OPCHAR:
+        case OPCLASS:
+        case OPMATCH:
+            threads.insert(threads.end(), t, t + w);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool DFA::hasMatch(const std::vector<uint32_t> &threads) const {
+    for (size_t i = 0; i < threads.size(); i += m_list.width()) {
+        if (OPCODE(m_code[threads[i]]) == OPMATCH)
+            return true;
+    }
+    return false;
+}
+
+// add a state to the cache, and return its index
+// key is the threads of the state, followed by DFA_FOUND_KEY after a match
+int32_t DFA::addState(const std::vector<uint32_t> &key) {
+    auto it = m_cache.find(key);
+    if (it != m_cache.end())
+        return it->second;
+
+    State st;
+    st.found = !key.empty() && key.back() == DFA_FOUND_KEY;
+    st.threads.assign(key.begin(), key.end() - st.found);
+    st.match = hasMatch(st.threads);
+    const std::vector<uint32_t> &threads = st.threads;
+    if (m_kind == DFA_ALL && st.match) {
+        for (size_t i = 0; i < threads.size(); i += m_list.width()) {
+            if (OPCODE(m_code[threads[i]]) == OPMATCH)
+                st.ids.push_back(OPX(m_code[threads[i]]));
+        }
+    }
+
+    int32_t s = m_states.size();
+    m_states.push_back(st);
+    m_built++;
+    m_trans.resize(m_trans.size() + m_stride, DFA_UNKNOWN);
+    m_cache[key] = s;
+
+    // threads is held by both the state and the key of the cache
+    m_mem += sizeof(State) + m_stride * sizeof(int32_t) +
+             (2 * key.size() + st.ids.size()) * sizeof(uint32_t) + 64;
+
+    return s;
+}
+
+// discard every state, and rebuild the start state
+void DFA::flush() {
+    m_states.clear();
+    m_trans.clear();
+    m_cache.clear();
+    m_mem = 0;
+    m_flushes++;
+
+    std::vector<uint32_t> threads;
+    m_list.clear();
+    addThread(m_prog, m_list, m_stack, 0, nullptr);
+    closure(threads);
+    m_start = addState(threads);
+}
+
+// compute the transition from the state s by the bytes of the byte class k
+// scanned is the number of bytes scanned so far, used to detect thrashing
+// canFail: if false, the transition is computed even if the cache is
+// thrashing, for the searches which have no fallback
+int32_t DFA::next(int32_t s, uint32_t k, size_t scanned, bool canFail) {
+    // every byte of k moves the threads in the same way
+    uint8_t c = m_rep[k];
+    m_misses++;
+
+    // step every "char" and "class" thread, in priority order
+    // by DFA_FIRST, "match" cuts the threads of lower priority
+    const std::vector<uint32_t> &threads = m_states[s].threads;
+    bool found = m_states[s].found;
+    uint32_t w = m_list.width();
+    m_list.clear();
+    for (size_t i = 0; i < threads.size(); i += w) {
+        uint32_t pc = threads[i];
+        Inst code = m_code[pc];
+        if (OPCODE(code) == OPMATCH && m_kind == DFA_FIRST) {
+            found = true;
+            break;
+        }
+        if ((OPCODE(code) == OPCHAR && OPX(code) == c) ||
+            (OPCODE(code) == OPCLASS && m_prog.classes[OPX(code)].test(c)))
+            addThread(m_prog, m_list, m_stack, pc + 1, &threads[i + 1]);
+    }
+
+    // unanchored: a new thread starts at every position until a match
+    if (!m_anchored && !found)
+        addThread(m_prog, m_list, m_stack, 0, nullptr);
+
+    std::vector<uint32_t> nthreads;
+    closure(nthreads);
+
+    int32_t t;
+    if (nthreads.empty()) {
+        t = DFA_DEAD;
+    } else {
+        if (m_kind == DFA_EXISTS && hasMatch(nthreads)) {
+            // no need to build the state, because a match stops the search
+            t = DFA_MATCH;
+        } else {
+            if (found)
+                nthreads.push_back(DFA_FOUND_KEY);
+            auto it = m_cache.find(nthreads);
+            if (it != m_cache.end()) {
+                t = it->second;
+            } else {
+                if (m_mem > m_budget) {
+                    // the cache is full
+                    size_t n = m_states.size();
+                    bool thrashing =
+                        scanned - m_flushScanned < DFA_MIN_BYTES_PER_STATE * n;
+
+                    flush();
+                    m_flushScanned = scanned;
+
+                    if (thrashing && canFail)
+                        return DFA_FAILED;
+
+                    // the transition is not memoized, because s was flushed
+                    return addState(nthreads);
+                }
+
+                t = addState(nthreads);
+            }
+        }
+    }
+
+    m_trans[(size_t)s * m_stride + k] = t;
+    return t;
+}
+
+// run the Pike VM instead of the DFA
+bool DFA::fallback(const char *str, size_t len) {
+    m_fallbacks++;
+
+    if (m_anchored)
+        return evalRegex(m_prog, str, len, &m_vmStats);
+
+    Match m;
+    return searchRegex(m_prog, str, len, m, &m_vmStats);
+}
+
+bool DFA::match(const char *str, size_t len) {
+    int32_t s = m_start;
+    if (m_states[s].match)
+        return true;
+
+    const uint8_t *byteClass = m_prog.byteClass;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t k = byteClass[(uint8_t)str[i]];
+        int32_t t = m_trans[(size_t)s * m_stride + k];
+        if (t < 0) {
+            if (t == DFA_UNKNOWN)
+                t = next(s, k, m_scanned + i);
+
+            switch (t) {
+            case DFA_DEAD:
+                m_scanned += i;
+                return false;
+            case DFA_MATCH:
+                m_scanned += i;
+                return true;
+            case DFA_FAILED:
+                m_scanned += i;
+                return fallback(str, len);
+            default:
+                break;
+            }
+        }
+        s = t;
+    }
+
+    m_scanned += len;
+    return false;
+}
+
+size_t DFA::matchBatch(const StringRef *strs, size_t n, uint64_t *bits) {
+    for (size_t i = 0; i < (n + 63) / 64; i++)
+        bits[i] = 0;
+
+    // the lane j scans strs[index[j]] from pos[j] in the state s[j]
+    size_t index[DFA_BATCH_LANES], pos[DFA_BATCH_LANES];
+    int32_t s[DFA_BATCH_LANES];
+    uint32_t active = 0;
+    size_t given = 0, matches = 0;
+
+    auto found = [&](size_t i) {
+        bits[i / 64] |= (uint64_t)1 << (i % 64);
+        matches++;
+    };
+    auto release = [&](uint32_t j) {
+        m_scanned += pos[j];
+        active--;
+        index[j] = index[active];
+        pos[j] = pos[active];
+        s[j] = s[active];
+    };
+
+    const uint8_t *byteClass = m_prog.byteClass;
+    for (;;) {
+        // give the next strings to the free lanes
+        while (active < DFA_BATCH_LANES && given < n) {
+            size_t i = given++;
+            if (m_states[m_start].match) {
+                found(i);
+                continue;
+            }
+            index[active] = i;
+            pos[active] = 0;
+            s[active] = m_start;
+            active++;
+        }
+        if (active == 0)
+            break;
+
+        // while every lane is busy, step them all together as long as no
+        // string ends and every transition is a known state, so that the
+        // loads of the lanes overlap
+        // the lanes are in locals, because the compilers keep arrays of
+        // them in memory
+        if (active == DFA_BATCH_LANES) {
+            const int32_t *trans = m_trans.data();
+            size_t stride = m_stride;
+            const uint8_t *p0 = (const uint8_t *)strs[index[0]].str + pos[0];
+            const uint8_t *p1 = (const uint8_t *)strs[index[1]].str + pos[1];
+            const uint8_t *p2 = (const uint8_t *)strs[index[2]].str + pos[2];
+            const uint8_t *p3 = (const uint8_t *)strs[index[3]].str + pos[3];
+            size_t steps = SIZE_MAX;
+            for (uint32_t j = 0; j < DFA_BATCH_LANES; j++)
+                steps = std::min(steps, strs[index[j]].len - pos[j]);
+
+            int32_t s0 = s[0], s1 = s[1], s2 = s[2], s3 = s[3];
+            size_t i = 0;
+            for (; i < steps; i++) {
+                int32_t t0 = trans[(size_t)s0 * stride + byteClass[p0[i]]];
+                int32_t t1 = trans[(size_t)s1 * stride + byteClass[p1[i]]];
+                int32_t t2 = trans[(size_t)s2 * stride + byteClass[p2[i]]];
+                int32_t t3 = trans[(size_t)s3 * stride + byteClass[p3[i]]];
+                if ((t0 | t1 | t2 | t3) < 0)
+                    break;
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+            }
+            s[0] = s0;
+            s[1] = s1;
+            s[2] = s2;
+            s[3] = s3;
+            for (uint32_t j = 0; j < DFA_BATCH_LANES; j++)
+                pos[j] += i;
+        }
+
+        // step every lane by one byte, which decides the strings at their
+        // end or at a transition which is not a known state
+        for (uint32_t j = 0; j < active; j++) {
+            const StringRef &r = strs[index[j]];
+            int32_t t = DFA_DEAD;
+            if (pos[j] < r.len) {
+                uint32_t k = byteClass[(uint8_t)r.str[pos[j]]];
+                t = m_trans[(size_t)s[j] * m_stride + k];
+                if (t == DFA_UNKNOWN) {
+                    size_t flushes = m_flushes;
+                    t = next(s[j], k, m_scanned);
+
+                    // the states of the lanes were flushed, so their strings
+                    // are matched again one by one, which cannot keep
+                    // flushing the states of each other
+                    if (m_flushes != flushes) {
+                        for (uint32_t o = 0; o < active; o++) {
+                            const StringRef &q = strs[index[o]];
+                            m_scanned += pos[o];
+                            if (match(q.str, q.len))
+                                found(index[o]);
+                        }
+                        active = 0;
+                        break;
+                    }
+                }
+                if (t >= 0) {
+                    s[j] = t;
+                    pos[j]++;
+                    continue;
+                }
+            }
+
+            // the string is decided, and the lane is free
+            if (t == DFA_MATCH || (t == DFA_FAILED && fallback(r.str, r.len)))
+                found(index[j]);
+            release(j--);
+        }
+    }
+
+    return matches;
+}
+
+bool DFA::find(const char *str, size_t len, size_t &end) {
+    int32_t s = m_start;
+    bool found = m_states[s].match;
+    if (found)
+        end = 0;
+
+    const uint8_t *byteClass = m_prog.byteClass;
+    size_t i = 0;
+    for (; i < len; i++) {
+        uint32_t k = byteClass[(uint8_t)str[i]];
+        int32_t t = m_trans[(size_t)s * m_stride + k];
+        if (t == DFA_UNKNOWN)
+            t = next(s, k, m_scanned + i, false);
+        if (t == DFA_DEAD)
+            break;
+        s = t;
+
+        if (m_states[s].match) {
+            end = i + 1;
+            found = true;
+        }
+    }
+
+    m_scanned += i;
+    return found;
+}
+
+bool DFA::rfind(const char *str, size_t len, size_t &start) {
+    int32_t s = m_start;
+    bool found = m_states[s].match;
+    if (found)
+        start = len;
+
+    const uint8_t *byteClass = m_prog.byteClass;
+    size_t i = len;
+    for (; i > 0; i--) {
+        uint32_t k = byteClass[(uint8_t)str[i - 1]];
+        int32_t t = m_trans[(size_t)s * m_stride + k];
+        if (t == DFA_UNKNOWN)
+            t = next(s, k, m_scanned + len - i, false);
+        if (t == DFA_DEAD)
+            break;
+        s = t;
+
+        if (m_states[s].match) {
+            start = i - 1;
+            found = true;
+        }
+    }
+
+    m_scanned += len - i;
+    return found;
+}
+
+// add the IDs of the state s not found yet
+static void addIds(const std::vector<uint32_t> &sids, std::vector<bool> &found,
+                   std::vector<uint32_t> &ids) {
+    for (uint32_t x : sids) {
+        if (!found[x]) {
+            found[x] = true;
+            ids.push_back(x);
+        }
+    }
+}
+
+void DFA::matchSet(const char *str, size_t len, std::vector<bool> &found,
+                   std::vector<uint32_t> &ids) {
+    // the number of ids once every pattern is found
+    size_t all = ids.size();
+    for (bool f : found)
+        all += !f;
+
+    int32_t s = m_start;
+    addIds(m_states[s].ids, found, ids);
+
+    const uint8_t *byteClass = m_prog.byteClass;
+    size_t i = 0;
+    for (; i < len && ids.size() < all; i++) {
+        uint32_t k = byteClass[(uint8_t)str[i]];
+        int32_t t = m_trans[(size_t)s * m_stride + k];
+        if (t < 0) {
+            if (t == DFA_UNKNOWN)
+                t = next(s, k, m_scanned + i);
+
+            switch (t) {
+            case DFA_DEAD:
+                m_scanned += i;
+                return;
+            case DFA_FAILED:
+                m_scanned += i;
+                m_fallbacks++;
+                searchSet(m_prog, str, len, found, ids, &m_vmStats);
+                return;
+            default:
+                break;
+            }
+        }
+        s = t;
+
+        if (m_states[s].match)
+            addIds(m_states[s].ids, found, ids);
+    }
+
+    m_scanned += i;
+}
+
+void DFA::addStats(Stats &stats) const {
+    stats.dfaBytes += m_scanned;
+    stats.dfaStates += m_built;
+    stats.dfaHits += m_scanned - m_misses;
+    stats.dfaMisses += m_misses;
+    stats.dfaFlushes += m_flushes;
+    stats.dfaFallbacks += m_fallbacks;
+    stats.merge(m_vmStats);
+}
+
+bool DFA::build() {
+    // states are appended while they are visited, so this is a BFS
+    for (size_t s = 0; s < m_states.size(); s++) {
+        if (m_states[s].match && m_kind == DFA_EXISTS)
+            continue;
+
+        for (uint32_t k = 0; k < m_stride; k++) {
+            if (m_trans[s * m_stride + k] != DFA_UNKNOWN)
+                continue;
+
+            // next() flushes the cache only if it is already full
+            if (m_mem > m_budget)
+                return false;
+
+            next(s, k, m_scanned);
+        }
+    }
+
+    return true;
+}
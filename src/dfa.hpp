@@ -0,0 +1,159 @@
+#ifndef DFA_HPP
+#define DFA_HPP
+
+#include "codegen.hpp"
+#include "stats.hpp"
+#include "stringref.hpp"
+#include "threadlist.hpp"
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+// special values of transitions
+#define DFA_UNKNOWN -1 // not yet computed
+#define DFA_DEAD -2    // no thread survives (anchored only)
+#define DFA_MATCH -3   // the next state has "match"
+#define DFA_FAILED -4  // the cache is thrashing
+
+// number of strings which matchBatch scans at once, for which its loop is
+// unrolled
+#define DFA_BATCH_LANES 4
+
+// what a DFA searches for
+enum DFAKind {
+    DFA_EXISTS, // whether there is a match, stopping at the first "match"
+    DFA_FIRST,  // the end of the leftmost-first match, as searchRegex
+    DFA_ALL     // every match, where "match" cuts no thread, for matchSet
+                // and the longest match
+};
+
+// lazily built DFA over the code generated by genCode
+//
+// every DFA state is the ordered set of "char", "class" and "match" threads
+// (PCs and counters) which the Pike VM would have at some position, and it is
+// built the first time the position is reached. transitions are memoized in a table
+// with an entry per byte class (see computeByteClasses) for every state.
+// when the cache outgrows its memory budget, every state is flushed and the
+// DFA starts again from the current state. if the cache keeps thrashing, the
+// match falls back to the Pike VM, while find and rfind go on from the
+// flushed cache.
+//
+// for the program of a RegexSet, the DFA is built with DFA_ALL, so that a
+// state with "match" does not stop the search, and every state records the
+// IDs of its "match" threads, which matchSet collects.
+//
+// with DFA_FIRST, a "match" cuts the threads of lower priority and no thread
+// starts after it, as in searchRegex, so the search ends where the leftmost-
+// first match ends. the span of a match is then found by find and by rfind
+// of the DFA of the reversed program (see MatchFinder).
+class DFA {
+  public:
+    // budget: upper bound of the memory used by the state cache in bytes
+    // anchored: if false, a match may start at any position
+    // kind: what match, find and matchSet search for
+    DFA(const Program &prog, size_t budget = 1 << 20, bool anchored = false,
+        DFAKind kind = DFA_EXISTS);
+
+    // return true if str[0..len) has a match
+    bool match(const char *str, size_t len);
+
+    // store the end of the last match found by scanning str[0..len) forward
+    // to end, which is the end of the leftmost-first match by DFA_FIRST, and
+    // the end of the longest match at str by DFA_ALL anchored
+    // return false if there is no match
+    bool find(const char *str, size_t len, size_t &end);
+
+    // store the start of the last match found by scanning str[0..len)
+    // backward from str + len to start, which is the leftmost start of the
+    // matches ending at str + len by the DFA_ALL anchored DFA of the
+    // reversed program
+    // return false if there is no match
+    bool rfind(const char *str, size_t len, size_t &start);
+
+    // set the bit i of bits if strs[i] has a match, for every i < n, where
+    // bits has (n + 63) / 64 words, and return the number of matches
+    // DFA_BATCH_LANES strings are scanned at once by turns, so that the
+    // loads of their transitions do not wait for each other
+    size_t matchBatch(const StringRef *strs, size_t n, uint64_t *bits);
+
+    // collect the patterns of a RegexSet which match str[0..len) like
+    // searchSet, and fall back to searchSet if the cache is thrashing
+    void matchSet(const char *str, size_t len, std::vector<bool> &found,
+                  std::vector<uint32_t> &ids);
+
+    // build every state reachable from the start state for ahead-of-time
+    // compilation, and return false if they do not fit in the budget
+    bool build();
+
+    // accessors for the states built so far
+    // a state is an index, and a transition is either a state or one of the
+    // special values above
+    int32_t start() const { return m_start; }
+    bool isMatch(int32_t s) const { return m_states[s].match; }
+    int32_t transition(int32_t s, uint8_t c) const {
+        return m_trans[(size_t)s * m_stride + m_prog.byteClass[c]];
+    }
+    const Program &program() const { return m_prog; }
+
+    size_t numStates() const { return m_states.size(); }
+    size_t numFlushes() const { return m_flushes; }
+    size_t numFallbacks() const { return m_fallbacks; }
+    size_t numBuilt() const { return m_built; }   // with the flushed ones
+    size_t numMisses() const { return m_misses; } // transitions computed
+    size_t numScanned() const { return m_scanned; }
+    const Stats &vmStats() const { return m_vmStats; } // of the fallbacks
+
+    // add the counters of the DFA and of its fallbacks to stats
+    void addStats(Stats &stats) const;
+
+  private:
+    struct State {
+        // "char", "class" and "match" threads in priority order, each of
+        // which is m_list.width() words
+        std::vector<uint32_t> threads;
+        bool match; // threads has "match"
+        bool found; // a match was found before, so no thread starts
+        std::vector<uint32_t> ids; // x of every "match x", if DFA_ALL
+    };
+
+    struct Hash {
+        size_t operator()(const std::vector<uint32_t> &threads) const;
+    };
+
+    void closure(std::vector<uint32_t> &threads);
+    bool hasMatch(const std::vector<uint32_t> &threads) const;
+    int32_t addState(const std::vector<uint32_t> &key);
+    int32_t next(int32_t s, uint32_t k, size_t scanned, bool canFail = true);
+    void flush();
+    bool fallback(const char *str, size_t len);
+
+    const Program &m_prog;
+    const std::vector<Inst> &m_code;
+    uint32_t m_stride;          // number of byte classes
+    std::vector<uint8_t> m_rep; // a byte of every byte class
+    size_t m_budget;
+    bool m_anchored;
+    DFAKind m_kind;
+
+    std::vector<State> m_states;
+    std::vector<int32_t> m_trans; // m_states.size() * m_stride transitions
+    std::unordered_map<std::vector<uint32_t>, int32_t, Hash> m_cache;
+    size_t m_mem; // bytes used by m_states, m_trans and m_cache
+    int32_t m_start;
+
+    // statistics, also used to detect thrashing
+    size_t m_flushes;
+    size_t m_fallbacks;
+    size_t m_built;
+    size_t m_misses;
+    size_t m_scanned;      // bytes scanned by every call of match
+    size_t m_flushScanned; // m_scanned at the last flush
+    Stats m_vmStats;
+
+    // scratch space to compute closures
+    ThreadList m_list;
+    std::vector<uint32_t> m_stack;
+};
+
+#endif // DFA_HPP
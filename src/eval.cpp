@@ -1,58 +1,530 @@
 #include "eval.hpp"
+
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+
+// push the thread of pc and counters[0..w - 1) to stack
+static void pushThread(std::vector<uint32_t> &stack, uint32_t w, uint32_t pc,
+                       const uint32_t *counters) {
+    stack.push_back(pc);
+    for (uint32_t j = 0; j + 1 < w; j++)
+        stack.push_back(counters != nullptr ? counters[j] : 0);
+}
+
+// count an iteration of "repeat x, y" for a thread whose counters are t
+// set exit if the thread may leave the loop, where the counter is reset to 0
+// so that the threads which only differ in dead counters are merged, and set
+// loop if it may go to y with the returned count
+static uint32_t countRepeat(const Program &prog, Inst inst, const uint32_t *t,
+                            bool &exit, bool &loop) {
+    const Repeat &r = prog.counters[OPX(inst)];
+    uint32_t n = t[OPX(inst)] + 1;
+
+    // after min iterations of "{min,}", the count no longer matters
+    if (r.max == REPEAT_INF && n > r.min)
+        n = r.min;
+
+    exit = n >= r.min;
+    loop = n < r.max;
+    return n;
+}
+
+// add a thread to the list, following "jmp", "split", "repeat" and "save"
+// eagerly so that the list only holds "char", "class" and "match" threads
+// (and the visited others, which are skipped by step)
+void addThread(const Program &prog, ThreadList &list,
+               std::vector<uint32_t> &stack, uint32_t pc,
+               const uint32_t *counters) {
+    const std::vector<Inst> &code = prog.code;
+    uint32_t w = list.width();
 
-static bool evalRegex(const std::vector<uint16_t> &code, const char *str,
-                      uint32_t PC, uint32_t SP) {
-    for (;;) {
-        if (str[SP] == '\0') {
-            if ((code[PC] & (3 << 14)) == OPMATCH) {
-                return true;
-            } else {
-                return false;
+    if (w == 1) {
+        // without counters, a thread is just a PC
+        stack.push_back(pc);
+        while (!stack.empty()) {
+            pc = stack.back();
+            stack.pop_back();
+
+            if (!list.insert(pc, nullptr))
+                continue;
+
+            switch (OPCODE(code[pc])) {
+            case OPJMP:
+                // code: jmp x
+                // description: CP = x (jump to the address x)
+                stack.push_back(OPX(code[pc]));
+                break;
+            case OPSPLIT:
+                // code: split x, y
+                // description: clone (one thread’s PC = x, and another’s
+                //              PC = y)
+                // push y first so that x is visited first (x has priority)
+                stack.push_back(OPY(code[pc]));
+                stack.push_back(OPX(code[pc]));
+                break;
+            case OPSAVE:
+                // code: save x
+                // description: captures are ignored, so just PC++
+                stack.push_back(pc + 1);
+                break;
+            default:
+                break;
             }
         }
+        return;
+    }
+
+    pushThread(stack, w, pc, counters);
+    while (!stack.empty()) {
+        size_t top = stack.size() - w;
+        pc = stack[top];
+        bool added = list.insert(pc, stack.data() + top + 1);
+        stack.resize(top);
+        if (!added)
+            continue;
+
+        // the counters of the thread, copied to the list
+        const uint32_t *t = list[list.size() - 1] + 1;
+
+        // "jmp", "split" and "save" keep the counters
+        switch (OPCODE(code[pc])) {
+        case OPJMP:
+            pushThread(stack, w, OPX(code[pc]), t);
+            break;
+        case OPSPLIT:
+            pushThread(stack, w, OPY(code[pc]), t);
+            pushThread(stack, w, OPX(code[pc]), t);
+            break;
+        case OPSAVE:
+            pushThread(stack, w, pc + 1, t);
+            break;
+        case OPREPEAT: {
+            // code: repeat x, y
+            // description: count an iteration of the counter x, and jump to
+            //              y, PC++ or clone by the count
+            uint32_t x = OPX(code[pc]);
+            bool exit, loop;
+            uint32_t n = countRepeat(prog, code[pc], t, exit, loop);
+
+            // push the loop last so that it has priority (greedy)
+            if (exit) {
+                pushThread(stack, w, pc + 1, t);
+                stack[stack.size() - w + 1 + x] = 0;
+            }
+            if (loop) {
+                pushThread(stack, w, OPY(code[pc]), t);
+                stack[stack.size() - w + 1 + x] = n;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// Pike VM
+// every thread is advanced in lockstep one input character at a time, and
+// threads with the same PC and counters are merged, so this takes
+// O(prog.code.size() * len) time without "repeat", and every counter
+// multiplies the threads by at most its bound
+bool evalRegex(const Program &prog, const char *str, size_t len,
+               Stats *stats) {
+    const std::vector<Inst> &code = prog.code;
+    ThreadList clist(code.size(), prog.counters.size());
+    ThreadList nlist(code.size(), prog.counters.size());
+    std::vector<uint32_t> stack;
+    bool found = false;
+    uint64_t insts = 0, threads = 0, splits = 0;
+
+    addThread(prog, clist, stack, 0, nullptr);
 
-        switch (code[PC] & (3 << 14)) {
-        case OPMATCH:
-            // code: match
-            // description: found
-            return true;
-        case OPCHAR: {
-            // code: char c
-            // description: if *SP != c then fail; else SP++ and CP++
-            char c = (char)code[PC];
-            if (c != str[SP]) {
-                return false;
-            } else {
-                SP++;
-                PC++;
+    size_t SP = 0;
+    for (; !clist.empty(); SP++) {
+        insts += clist.size();
+        for (uint32_t i = 0; i < clist.size(); i++) {
+            uint32_t PC = clist[i][0];
+            switch (OPCODE(code[PC])) {
+            case OPMATCH:
+                // code: match
+                // description: found
+                found = true;
+                i = clist.size();
+                break;
+            case OPCHAR: {
+                // code: char c
+                // description: if *SP != c then fail; else SP++ and CP++
+                char c = (char)OPX(code[PC]);
+                if (SP < len && c == str[SP]) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1);
+                    threads++;
+                }
+                break;
+            }
+            case OPCLASS: {
+                // code: class x
+                // description: if *SP is not in x then fail; else SP++ and
+                //              CP++
+                const ByteSet &set = prog.classes[OPX(code[PC])];
+                if (SP < len && set.test(str[SP])) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1);
+                    threads++;
+                }
+                break;
+            }
+            default:
+                // the others were already followed by addThread
+                splits += OPCODE(code[PC]) == OPSPLIT ||
+                          OPCODE(code[PC]) == OPREPEAT;
                 break;
             }
         }
-        case OPJMP: {
-            // code: jmp x
-            // description: CP = x (jump to the address x)
 
-            // implement here
-            assert(false); // not yet implemented, remove this line
+        if (found || SP == len)
+            break;
+
+        clist.swap(nlist);
+        nlist.clear();
+    }
+
+    if (stats != nullptr) {
+        stats->vmRuns++;
+        stats->vmBytes += SP;
+        stats->vmInsts += insts;
+        stats->vmThreads += threads;
+        stats->vmSplits += splits;
+    }
+    return found;
+}
 
+bool evalRegex(const Program &prog, const char *str) {
+    return evalRegex(prog, str, strlen(str));
+}
+
+// add a thread like addThread, and record that the threads newly added to
+// the list started at sp
+// start[i] is the start of the i-th thread of list
+static void addThread(const Program &prog, ThreadList &list,
+                      std::vector<uint32_t> &stack, uint32_t pc,
+                      const uint32_t *counters, std::vector<size_t> &start,
+                      size_t sp) {
+    addThread(prog, list, stack, pc, counters);
+    while (start.size() < list.size())
+        start.push_back(sp);
+}
+
+// Pike VM for unanchored search
+// a new lowest-priority thread starts at every position until a match is
+// found, and every thread carries the position where it started. when a
+// thread reaches "match", the threads of lower priority are discarded, so
+// the result is the leftmost match which a backtracking engine would report
+bool searchRegex(const Program &prog, const char *str, size_t len,
+                 Match &m, Stats *stats) {
+    const std::vector<Inst> &code = prog.code;
+    ThreadList clist(code.size(), prog.counters.size());
+    ThreadList nlist(code.size(), prog.counters.size());
+    std::vector<size_t> cstart, nstart;
+    cstart.reserve(code.size());
+    nstart.reserve(code.size());
+    std::vector<uint32_t> stack;
+    bool found = false;
+    uint64_t insts = 0, threads = 0, splits = 0;
+
+    size_t SP = 0;
+    for (;; SP++) {
+        // a match starting at SP has the lowest priority
+        if (!found)
+            addThread(prog, clist, stack, 0, nullptr, cstart, SP);
+
+        insts += clist.size();
+        for (uint32_t i = 0; i < clist.size(); i++) {
+            uint32_t PC = clist[i][0];
+            switch (OPCODE(code[PC])) {
+            case OPMATCH:
+                // code: match
+                // description: found, and cut threads of lower priority
+                m.offset = cstart[i];
+                m.length = SP - cstart[i];
+                found = true;
+                i = clist.size();
+                break;
+            case OPCHAR: {
+                // code: char c
+                // description: if *SP != c then fail; else SP++ and CP++
+                char c = (char)OPX(code[PC]);
+                if (SP < len && c == str[SP]) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1,
+                              nstart, cstart[i]);
+                    threads++;
+                }
+                break;
+            }
+            case OPCLASS: {
+                // code: class x
+                // description: if *SP is not in x then fail; else SP++ and
+                //              CP++
+                const ByteSet &set = prog.classes[OPX(code[PC])];
+                if (SP < len && set.test(str[SP])) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1,
+                              nstart, cstart[i]);
+                    threads++;
+                }
+                break;
+            }
+            default:
+                // the others were already followed by addThread
+                splits += OPCODE(code[PC]) == OPSPLIT ||
+                          OPCODE(code[PC]) == OPREPEAT;
+                break;
+            }
+        }
+
+        if (SP == len || (found && nlist.empty()))
             break;
+
+        clist.swap(nlist);
+        cstart.swap(nstart);
+        nlist.clear();
+        nstart.clear();
+    }
+
+    if (stats != nullptr) {
+        stats->vmRuns++;
+        stats->vmBytes += SP;
+        stats->vmInsts += insts;
+        stats->vmThreads += threads;
+        stats->vmSplits += splits;
+    }
+    return found;
+}
+
+// Pike VM for a RegexSet
+// like searchRegex, a new thread starts at every position, but no thread is
+// discarded by a match, so every pattern which matches somewhere reaches its
+// "match" while the threads of all the patterns advance in lockstep
+void searchSet(const Program &prog, const char *str, size_t len,
+               std::vector<bool> &found, std::vector<uint32_t> &ids,
+               Stats *stats) {
+    const std::vector<Inst> &code = prog.code;
+    ThreadList clist(code.size(), prog.counters.size());
+    ThreadList nlist(code.size(), prog.counters.size());
+    std::vector<uint32_t> stack;
+    size_t left = 0; // patterns not found yet
+    for (bool f : found)
+        left += !f;
+    uint64_t insts = 0, threads = 0, splits = 0;
+
+    size_t SP = 0;
+    for (; left > 0; SP++) {
+        addThread(prog, clist, stack, 0, nullptr);
+
+        insts += clist.size();
+        for (uint32_t i = 0; i < clist.size(); i++) {
+            uint32_t PC = clist[i][0];
+            switch (OPCODE(code[PC])) {
+            case OPMATCH: {
+                // code: match x
+                // description: found the pattern x
+                uint32_t x = OPX(code[PC]);
+                if (!found[x]) {
+                    found[x] = true;
+                    ids.push_back(x);
+                    left--;
+                }
+                break;
+            }
+            case OPCHAR: {
+                // code: char c
+                // description: if *SP != c then fail; else SP++ and CP++
+                char c = (char)OPX(code[PC]);
+                if (SP < len && c == str[SP]) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1);
+                    threads++;
+                }
+                break;
+            }
+            case OPCLASS: {
+                // code: class x
+                // description: if *SP is not in x then fail; else SP++ and
+                //              CP++
+                const ByteSet &set = prog.classes[OPX(code[PC])];
+                if (SP < len && set.test(str[SP])) {
+                    addThread(prog, nlist, stack, PC + 1, clist[i] + 1);
+                    threads++;
+                }
+                break;
+            }
+            default:
+                // the others were already followed by addThread
+                splits += OPCODE(code[PC]) == OPSPLIT ||
+                          OPCODE(code[PC]) == OPREPEAT;
+                break;
+            }
         }
-        case OPSPLIT: {
-            // code: split x, y
-            // description: clone (one thread’s PC = x, and another’s PC = y)
 
-            // implement here
-            assert(false); // not yet implemented, remove this line
+        if (SP == len)
+            break;
+
+        clist.swap(nlist);
+        nlist.clear();
+    }
+
+    if (stats != nullptr) {
+        stats->vmRuns++;
+        stats->vmBytes += SP;
+        stats->vmInsts += insts;
+        stats->vmThreads += threads;
+        stats->vmSplits += splits;
+    }
+}
+
+// sentinel of Frame::pc
+#define NO_PC ((uint32_t)-1)
+
+CaptureVM::CaptureVM(const Program &prog)
+    : m_prog(prog), m_numSlots(2 * prog.numCaptures),
+      m_clist(prog.code.size(), prog.counters.size()),
+      m_nlist(prog.code.size(), prog.counters.size()),
+      m_cpool(prog.code.size() * m_numSlots),
+      m_npool(prog.code.size() * m_numSlots), m_slots(m_numSlots) {}
+
+// add a thread to the list like addThread, and copy the slots to the pool
+// for every "char", "class" and "match" thread
+// "save" stores sp to a slot of m_slots, and restores it after every thread
+// which follows it has been added, so the threads of higher priority are
+// added first, with the slots of their own paths
+void CaptureVM::follow(ThreadList &list, std::vector<size_t> &pool,
+                       uint32_t pc, const uint32_t *counters, size_t sp) {
+    const std::vector<Inst> &code = m_prog.code;
+    uint32_t numCounters = list.width() - 1;
 
+    auto push = [&](uint32_t pc, const uint32_t *counters) {
+        Frame f = {pc, 0, 0};
+        m_frames.push_back(f);
+        for (uint32_t j = 0; j < numCounters; j++)
+            m_counters.push_back(counters != nullptr ? counters[j] : 0);
+    };
+
+    push(pc, counters);
+    while (!m_frames.empty()) {
+        Frame f = m_frames.back();
+        m_frames.pop_back();
+        size_t top = m_counters.size() - numCounters;
+
+        if (f.pc == NO_PC) {
+            m_slots[f.slot] = f.value;
+            m_counters.resize(top);
+            continue;
+        }
+
+        bool added = list.insert(f.pc, m_counters.data() + top);
+        m_counters.resize(top);
+        if (!added)
+            continue;
+
+        uint32_t i = list.size() - 1;
+        const uint32_t *t = list[i] + 1;
+        Inst inst = code[f.pc];
+
+        switch (OPCODE(inst)) {
+        case OPJMP:
+            push(OPX(inst), t);
+            break;
+        case OPSPLIT:
+            push(OPY(inst), t);
+            push(OPX(inst), t);
+            break;
+        case OPREPEAT: {
+            uint32_t x = OPX(inst);
+            bool exit, loop;
+            uint32_t n = countRepeat(m_prog, inst, t, exit, loop);
+            if (exit) {
+                push(f.pc + 1, t);
+                m_counters[m_counters.size() - numCounters + x] = 0;
+            }
+            if (loop) {
+                push(OPY(inst), t);
+                m_counters[m_counters.size() - numCounters + x] = n;
+            }
+            break;
+        }
+        case OPSAVE: {
+            // code: save x
+            // description: slot x = SP, and PC++
+            Frame r = {NO_PC, OPX(inst), m_slots[OPX(inst)]};
+            m_frames.push_back(r);
+            m_counters.insert(m_counters.end(), numCounters, 0);
+            m_slots[OPX(inst)] = sp;
+            push(f.pc + 1, t);
             break;
         }
         default:
+            // "char", "class" and "match" keep the slots
+            if (pool.size() < (size_t)(i + 1) * m_numSlots)
+                pool.resize((size_t)(i + 1) * m_numSlots);
+            std::copy(m_slots.begin(), m_slots.end(),
+                      pool.begin() + (size_t)i * m_numSlots);
             break;
         }
     }
 }
 
-bool evalRegex(const std::vector<uint16_t> &code, const char *str) {
-    return evalRegex(code, str, 0, 0);
-}
\ No newline at end of file
+// Pike VM for unanchored search like searchRegex, where the slots of the
+// group 0 are the start of the thread and the position of "match"
+bool CaptureVM::match(const char *str, size_t len, size_t *spans) {
+    const std::vector<Inst> &code = m_prog.code;
+    bool found = false;
+
+    m_clist.clear();
+    m_nlist.clear();
+
+    for (size_t SP = 0;; SP++) {
+        // a match starting at SP has the lowest priority
+        if (!found) {
+            std::fill(m_slots.begin(), m_slots.end(), NO_SPAN);
+            m_slots[0] = SP;
+            follow(m_clist, m_cpool, 0, nullptr, SP);
+        }
+
+        for (uint32_t i = 0; i < m_clist.size(); i++) {
+            const uint32_t *t = m_clist[i];
+            const size_t *slots = &m_cpool[(size_t)i * m_numSlots];
+            bool step = false;
+
+            switch (OPCODE(code[t[0]])) {
+            case OPMATCH:
+                // code: match
+                // description: found, and cut threads of lower priority
+                std::copy(slots, slots + m_numSlots, spans);
+                spans[1] = SP;
+                found = true;
+                i = m_clist.size();
+                break;
+            case OPCHAR:
+                step = SP < len && (char)OPX(code[t[0]]) == str[SP];
+                break;
+            case OPCLASS:
+                step = SP < len &&
+                       m_prog.classes[OPX(code[t[0]])].test(str[SP]);
+                break;
+            default:
+                break;
+            }
+
+            if (step) {
+                std::copy(slots, slots + m_numSlots, m_slots.begin());
+                follow(m_nlist, m_npool, t[0] + 1, t + 1, SP + 1);
+            }
+        }
+
+        if (SP == len || (found && m_nlist.empty()))
+            break;
+
+        m_clist.swap(m_nlist);
+        m_cpool.swap(m_npool);
+        m_nlist.clear();
+    }
+
+    return found;
+}
@@ -2,7 +2,87 @@
 #define EVAL_HPP
 
 #include "codegen.hpp"
+#include "stats.hpp"
+#include "threadlist.hpp"
 
-bool evalRegex(const std::vector<uint16_t> &code, const char *str);
+#include <cstddef>
 
-#endif // EVAL_HPP
\ No newline at end of file
+bool evalRegex(const Program &prog, const char *str);
+bool evalRegex(const Program &prog, const char *str, size_t len,
+               Stats *stats = nullptr);
+
+// a match found by searchRegex
+struct Match {
+    size_t offset; // position of the first character of the match
+    size_t length; // number of characters of the match
+};
+
+// search the leftmost match in str[0..len) in a single pass
+// return false if there is no match
+// the counters of the Pike VM are added to stats unless it is nullptr
+bool searchRegex(const Program &prog, const char *str, size_t len,
+                 Match &m, Stats *stats = nullptr);
+
+// search the matches of every pattern of the program of a RegexSet in
+// str[0..len) in a single pass, where "match x" is a match of the pattern x
+// for every pattern matched for the first time, found[x] is set and x is
+// appended to ids, and the search stops once every pattern has matched
+// found must have an element for every pattern
+void searchSet(const Program &prog, const char *str, size_t len,
+               std::vector<bool> &found, std::vector<uint32_t> &ids,
+               Stats *stats = nullptr);
+
+// offset of a group which did not take part in a match
+#define NO_SPAN ((size_t)-1)
+
+// Pike VM which extracts the submatches of the capture groups
+// every thread carries its own copy of the capture slots, and the copies live
+// in pools owned by the VM, which are reused by every call of match, so that
+// extracting captures line by line never allocates once the pools have grown
+// to the largest thread list
+class CaptureVM {
+  public:
+    CaptureVM(const Program &prog);
+
+    // search the leftmost match in str[0..len), and store the offsets of
+    // the start and the end of the group i to spans[2 * i] and
+    // spans[2 * i + 1] for every group, where the group 0 is the whole match
+    // spans must have 2 * numCaptures() elements
+    // return false if there is no match
+    bool match(const char *str, size_t len, size_t *spans);
+
+    uint32_t numCaptures() const { return m_prog.numCaptures; }
+
+  private:
+    // a frame of the stack of follow, which either follows pc or restores
+    // the slot of m_slots
+    struct Frame {
+        uint32_t pc; // NO_PC to restore the slot
+        uint32_t slot;
+        size_t value;
+    };
+
+    void follow(ThreadList &list, std::vector<size_t> &pool, uint32_t pc,
+                const uint32_t *counters, size_t sp);
+
+    const Program &m_prog;
+    uint32_t m_numSlots;
+
+    // the slots of the i-th thread of m_clist are
+    // m_cpool[i * m_numSlots..(i + 1) * m_numSlots), and so on
+    ThreadList m_clist, m_nlist;
+    std::vector<size_t> m_cpool, m_npool;
+
+    std::vector<size_t> m_slots; // slots of the thread being followed
+    std::vector<Frame> m_frames;
+    std::vector<uint32_t> m_counters; // counters of m_frames
+};
+
+// add the thread of pc and counters, and every thread reachable from it
+// through "jmp", "split" and "repeat", to list in priority order
+// counters has list.width() - 1 values, or is nullptr for zeros
+void addThread(const Program &prog, ThreadList &list,
+               std::vector<uint32_t> &stack, uint32_t pc,
+               const uint32_t *counters);
+
+#endif // EVAL_HPP
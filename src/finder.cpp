@@ -0,0 +1,34 @@
+#include "finder.hpp"
+
+MatchFinder::MatchFinder(const Program &prog, const Program &reverse,
+                         bool longest)
+    : m_longest(longest), m_forward(prog, 1 << 20, false, DFA_FIRST),
+      m_reverse(reverse, 1 << 20, true, DFA_ALL),
+      m_longestDFA(prog, 1 << 20, true, DFA_ALL) {}
+
+bool MatchFinder::find(const char *str, size_t len, Match &m) {
+    size_t start, end;
+    if (!m_forward.find(str, len, end))
+        return false;
+
+    // the reversed regex matches str[start..end) backward at least for the
+    // start of the leftmost-first match, so rfind always finds one
+    start = 0;
+    m_reverse.rfind(str, end, start);
+
+    // the longest match from start ends at end or after it
+    if (m_longest) {
+        m_longestDFA.find(str + start, len - start, end);
+        end += start;
+    }
+
+    m.offset = start;
+    m.length = end - start;
+    return true;
+}
+
+void MatchFinder::addStats(Stats &stats) const {
+    m_forward.addStats(stats);
+    m_reverse.addStats(stats);
+    m_longestDFA.addStats(stats);
+}
@@ -0,0 +1,44 @@
+#ifndef FINDER_HPP
+#define FINDER_HPP
+
+#include "dfa.hpp"
+#include "eval.hpp"
+
+#include <cstddef>
+
+// finder of the span of the leftmost match by DFAs in two linear passes
+//
+// the unanchored DFA_FIRST DFA of the regex scans forward to the end of the
+// leftmost-first match, and the anchored DFA of the reversed regex scans
+// backward from there to the leftmost start of the matches ending there,
+// which is the start of the leftmost-first match, because no match starts
+// before it. for the leftmost-longest match (POSIX), a third pass scans
+// forward from that start to the end of the longest match.
+//
+// only the whole match is found, not the groups
+class MatchFinder {
+  public:
+    // prog: the program of the regex
+    // reverse: the program of the reversed regex (see reverseRegex)
+    // longest: if true, find the leftmost-longest match instead of the
+    //          leftmost-first one
+    MatchFinder(const Program &prog, const Program &reverse,
+                bool longest = false);
+
+    // search the leftmost match in str[0..len)
+    // return false if there is no match
+    bool find(const char *str, size_t len, Match &m);
+
+    bool longest() const { return m_longest; }
+
+    // add the counters of the DFAs to stats
+    void addStats(Stats &stats) const;
+
+  private:
+    bool m_longest;
+    DFA m_forward;    // unanchored, to the end of the leftmost-first match
+    DFA m_reverse;    // anchored, backward to the start
+    DFA m_longestDFA; // anchored, to the end of the longest match
+};
+
+#endif // FINDER_HPP
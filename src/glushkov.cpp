@@ -0,0 +1,510 @@
+#include "glushkov.hpp"
+#include "serial.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+// the number of words of the largest automaton
+#define GLUSHKOV_MAX_WORDS (GLUSHKOV_MAX_POSITIONS / 64)
+
+// number of the positions of the subtree at n, or GLUSHKOV_MAX_POSITIONS + 1
+// if there are more
+static uint64_t countPositions(const TRTree &tree, TRIndex n) {
+    const uint64_t over = GLUSHKOV_MAX_POSITIONS + 1;
+    const TRNode &e = tree[n];
+    uint64_t ret = 0;
+    switch (e.kind) {
+    case TR_CHAR:
+    case TR_CLASS:
+        return 1;
+    case TR_STRING:
+        ret = e.right;
+        break;
+    case TR_MATCH:
+        return 0;
+    case TR_EXPRS:
+        for (uint32_t i = 0; i < e.right && ret < over; i++)
+            ret += countPositions(tree, tree.child(n, i));
+        break;
+    case TR_OR:
+        ret = countPositions(tree, e.left) + countPositions(tree, e.right);
+        break;
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION:
+    case TR_CAPTURE:
+        return countPositions(tree, e.left);
+    case TR_REPEAT: {
+        // min copies and a star, or max copies
+        const Repeat &r = tree.repeats[e.right];
+        uint64_t copies = r.max == REPEAT_INF ? (uint64_t)r.min + 1 : r.max;
+        ret = countPositions(tree, e.left) * copies;
+        break;
+    }
+    }
+    return ret < over ? ret : over;
+}
+
+static bool test(const std::vector<uint64_t> &set, uint32_t p) {
+    return (set[p / 64] >> (p % 64)) & 1;
+}
+
+static void merge(std::vector<uint64_t> &set, const std::vector<uint64_t> &s) {
+    for (size_t i = 0; i < set.size(); i++)
+        set[i] |= s[i];
+}
+
+Glushkov::Glushkov() : m_positions(0), m_words(1), m_nullable(false) {}
+
+Glushkov::Info Glushkov::position(const ByteSet &set) {
+    uint32_t p = m_positions++;
+    for (int c = 0; c < 256; c++) {
+        if (set.test(c))
+            m_masks[c * m_words + p / 64] |= (uint64_t)1 << (p % 64);
+    }
+
+    Info ret;
+    ret.first.assign(m_words, 0);
+    ret.first[p / 64] |= (uint64_t)1 << (p % 64);
+    ret.last = ret.first;
+    ret.nullable = false;
+    return ret;
+}
+
+// a is a followed by b
+void Glushkov::concat(Info &a, const Info &b) {
+    for (uint32_t p = 0; p < m_positions; p++) {
+        if (test(a.last, p))
+            merge(m_followers[p], b.first);
+    }
+
+    if (a.nullable)
+        merge(a.first, b.first);
+    if (b.nullable)
+        merge(a.last, b.last);
+    else
+        a.last = b.last;
+    a.nullable = a.nullable && b.nullable;
+}
+
+// a may be repeated
+void Glushkov::loop(const Info &a) {
+    for (uint32_t p = 0; p < m_positions; p++) {
+        if (test(a.last, p))
+            merge(m_followers[p], a.first);
+    }
+}
+
+// visit the subtree at n, and add its positions from left to right
+Glushkov::Info Glushkov::visit(const TRTree &tree, TRIndex n) {
+    const TRNode &e = tree[n];
+
+    // the empty string
+    Info ret;
+    ret.first.assign(m_words, 0);
+    ret.last.assign(m_words, 0);
+    ret.nullable = true;
+
+    switch (e.kind) {
+    case TR_CHAR: {
+        ByteSet set;
+        set.add(e.c);
+        return position(set);
+    }
+    case TR_CLASS:
+        return position(tree.classes[e.left]);
+    case TR_STRING:
+        for (char c : tree.string(n)) {
+            ByteSet set;
+            set.add(c);
+            concat(ret, position(set));
+        }
+        return ret;
+    case TR_MATCH:
+        return ret;
+    case TR_EXPRS:
+        for (uint32_t i = 0; i < e.right; i++)
+            concat(ret, visit(tree, tree.child(n, i)));
+        return ret;
+    case TR_OR: {
+        ret = visit(tree, e.left);
+        Info b = visit(tree, e.right);
+        merge(ret.first, b.first);
+        merge(ret.last, b.last);
+        ret.nullable = ret.nullable || b.nullable;
+        return ret;
+    }
+    case TR_PLUS:
+        ret = visit(tree, e.left);
+        loop(ret);
+        return ret;
+    case TR_STAR:
+        ret = visit(tree, e.left);
+        loop(ret);
+        ret.nullable = true;
+        return ret;
+    case TR_QUESTION:
+        ret = visit(tree, e.left);
+        ret.nullable = true;
+        return ret;
+    case TR_CAPTURE:
+        return visit(tree, e.left);
+    case TR_REPEAT: {
+        const Repeat &r = tree.repeats[e.right];
+        for (uint32_t i = 0; i < r.min; i++)
+            concat(ret, visit(tree, e.left));
+
+        // "x{min,}" is min copies of x followed by "x*", and "x{min,max}"
+        // is followed by max - min copies of "x?"
+        if (r.max == REPEAT_INF) {
+            Info x = visit(tree, e.left);
+            loop(x);
+            x.nullable = true;
+            concat(ret, x);
+        } else {
+            for (uint32_t i = r.min; i < r.max; i++) {
+                Info x = visit(tree, e.left);
+                x.nullable = true;
+                concat(ret, x);
+            }
+        }
+        return ret;
+    }
+    }
+
+    assert(false); // never reach here if every operation is implemented
+    return ret;
+}
+
+bool Glushkov::build(const TRTree &tree) {
+    uint64_t n = countPositions(tree, tree.root);
+    if (n > GLUSHKOV_MAX_POSITIONS)
+        return false;
+
+    m_positions = 0;
+    m_words = n > 0 ? (n + 63) / 64 : 1;
+    m_masks.assign(256 * m_words, 0);
+    m_followers.assign(n, std::vector<uint64_t>(m_words, 0));
+
+    Info root = visit(tree, tree.root);
+    assert(m_positions == n);
+    m_first = root.first;
+    m_last = root.last;
+    m_nullable = root.nullable;
+
+    // p -> p + 1 is the shift
+    m_shift.assign(m_words, 0);
+    for (uint32_t p = 0; p + 1 < m_positions; p++) {
+        std::vector<uint64_t> &f = m_followers[p];
+        uint32_t q = p + 1;
+        if (test(f, q)) {
+            m_shift[q / 64] |= (uint64_t)1 << (q % 64);
+            f[q / 64] &= ~((uint64_t)1 << (q % 64));
+        }
+    }
+
+    // tables of the other transitions of every 8 positions which have some
+    m_chunks.clear();
+    m_follow.clear();
+    for (uint32_t k = 0; k * 8 < m_positions; k++) {
+        bool used = false;
+        for (uint32_t p = k * 8; p < m_positions && p < k * 8 + 8; p++) {
+            for (uint64_t w : m_followers[p])
+                used = used || w != 0;
+        }
+        if (!used)
+            continue;
+
+        size_t base = m_follow.size();
+        m_chunks.push_back(k);
+        m_follow.resize(base + 256 * m_words, 0);
+        for (uint32_t b = 1; b < 256; b++) {
+            // the entry of b is the one of b without its lowest bit, and the
+            // followers of the position of the lowest bit
+            uint64_t *entry = &m_follow[base + b * m_words];
+            const uint64_t *rest = &m_follow[base + (b & (b - 1)) * m_words];
+            uint32_t p = k * 8 + __builtin_ctz(b);
+            for (uint32_t i = 0; i < m_words; i++) {
+                entry[i] = rest[i];
+                if (p < m_positions)
+                    entry[i] |= m_followers[p][i];
+            }
+        }
+    }
+
+    m_followers.clear();
+    return true;
+}
+
+void Glushkov::save(std::string &data) const {
+    putU32(data, m_positions);
+    putU32(data, m_words);
+    putU32(data, m_nullable);
+    putArray(data, m_masks);
+    putArray(data, m_first);
+    putArray(data, m_last);
+    putArray(data, m_shift);
+    putArray(data, m_chunks);
+    putArray(data, m_follow);
+}
+
+bool Glushkov::load(const char *data, size_t size) {
+    Reader r = {data, data + size};
+    uint32_t positions, words, nullable;
+    std::vector<uint64_t> masks, first, last, shift, follow;
+    std::vector<uint32_t> chunks;
+    if (!r.getU32(positions) || !r.getU32(words) || !r.getU32(nullable) ||
+        !r.getArray(masks) || !r.getArray(first) || !r.getArray(last) ||
+        !r.getArray(shift) || !r.getArray(chunks) || !r.getArray(follow) ||
+        r.p != r.end)
+        return false;
+
+    // the tables have the sizes of build, and every chunk is of positions
+    // in the words, so match never reads out of them
+    if (positions > GLUSHKOV_MAX_POSITIONS ||
+        words != (positions > 0 ? (positions + 63) / 64 : 1) ||
+        masks.size() != 256 * words || first.size() != words ||
+        last.size() != words || shift.size() != words ||
+        follow.size() != chunks.size() * 256 * words)
+        return false;
+    for (uint32_t k : chunks) {
+        if (k >= (positions + 7) / 8)
+            return false;
+    }
+
+    m_positions = positions;
+    m_words = words;
+    m_nullable = nullable != 0;
+    m_masks.swap(masks);
+    m_first.swap(first);
+    m_last.swap(last);
+    m_shift.swap(shift);
+    m_chunks.swap(chunks);
+    m_follow.swap(follow);
+    return true;
+}
+
+size_t Glushkov::bytes() const {
+    return sizeof(*this) +
+           (m_masks.size() + m_first.size() + m_last.size() +
+            m_shift.size() + m_follow.size()) *
+               sizeof(uint64_t) +
+           m_chunks.size() * sizeof(uint32_t);
+}
+
+// match by an automaton of one word
+bool Glushkov::match1(const char *str, size_t len, bool anchored) const {
+    const uint64_t *masks = m_masks.data();
+    const uint64_t *follow = m_follow.data();
+    const uint32_t *chunks = m_chunks.data();
+    size_t numChunks = m_chunks.size();
+    uint64_t shift = m_shift[0], last = m_last[0];
+    uint64_t first = m_first[0];
+
+    uint64_t d = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint64_t n = ((d << 1) & shift) | first;
+        for (size_t k = 0; k < numChunks; k++)
+            n |= follow[k * 256 + ((d >> (8 * chunks[k])) & 255)];
+        d = n & masks[(uint8_t)str[i]];
+        if ((d & last) != 0)
+            return true;
+
+        // an anchored match starts only at str
+        if (anchored) {
+            if (d == 0)
+                return false;
+            first = 0;
+        }
+    }
+    return false;
+}
+
+// match by an automaton of several words
+bool Glushkov::matchN(const char *str, size_t len, bool anchored) const {
+    uint32_t words = m_words;
+    const uint64_t *follow = m_follow.data();
+    size_t numChunks = m_chunks.size();
+    bool start = true;
+
+    uint64_t d[GLUSHKOV_MAX_WORDS] = {0};
+    uint64_t n[GLUSHKOV_MAX_WORDS];
+    for (size_t i = 0; i < len; i++) {
+        // shift across the words
+        uint64_t carry = 0;
+        for (uint32_t w = 0; w < words; w++) {
+            n[w] = ((d[w] << 1) | carry) & m_shift[w];
+            carry = d[w] >> 63;
+            if (start)
+                n[w] |= m_first[w];
+        }
+
+        for (size_t k = 0; k < numChunks; k++) {
+            uint32_t p = 8 * m_chunks[k];
+            uint32_t b = (d[p / 64] >> (p % 64)) & 255;
+            const uint64_t *entry = &follow[(k * 256 + b) * words];
+            for (uint32_t w = 0; w < words; w++)
+                n[w] |= entry[w];
+        }
+
+        const uint64_t *mask = &m_masks[(uint8_t)str[i] * words];
+        uint64_t any = 0, found = 0;
+        for (uint32_t w = 0; w < words; w++) {
+            d[w] = n[w] & mask[w];
+            any |= d[w];
+            found |= d[w] & m_last[w];
+        }
+        if (found != 0)
+            return true;
+
+        if (anchored) {
+            if (any == 0)
+                return false;
+            start = false;
+        }
+    }
+    return false;
+}
+
+size_t Glushkov::matchBatch(const StringRef *strs, size_t n, uint64_t *bits,
+                            bool anchored) const {
+    for (size_t i = 0; i < (n + 63) / 64; i++)
+        bits[i] = 0;
+    size_t matches = 0;
+
+    if (m_words != 1 || m_nullable) {
+        for (size_t i = 0; i < n; i++) {
+            if (match(strs[i].str, strs[i].len, anchored)) {
+                bits[i / 64] |= (uint64_t)1 << (i % 64);
+                matches++;
+            }
+        }
+        return matches;
+    }
+
+    // a lane scans strs[index] from pos with the positions d, as match1
+    struct Lane {
+        size_t index;
+        size_t pos;
+        uint64_t d;
+        uint64_t first;
+    };
+    Lane lanes[GLUSHKOV_BATCH_LANES];
+    uint32_t active = 0;
+    size_t given = 0;
+
+    const uint64_t *masks = m_masks.data();
+    const uint64_t *follow = m_follow.data();
+    const uint32_t *chunks = m_chunks.data();
+    size_t numChunks = m_chunks.size();
+    uint64_t shift = m_shift[0], last = m_last[0];
+
+    for (;;) {
+        // give the next strings to the free lanes
+        while (active < GLUSHKOV_BATCH_LANES && given < n) {
+            size_t i = given++;
+            if (strs[i].len == 0)
+                continue;
+            Lane &l = lanes[active++];
+            l.index = i;
+            l.pos = 0;
+            l.d = 0;
+            l.first = m_first[0];
+        }
+        if (active == 0)
+            break;
+
+        // while every lane is busy, step them all together as long as no
+        // string is decided, so that the loads of the lanes overlap, and
+        // leave the last byte of every string to the loop below
+        // the lanes are in locals, because the compilers keep arrays of
+        // them in memory
+        if (active == GLUSHKOV_BATCH_LANES) {
+            auto step = [&](uint64_t d, uint64_t first, uint8_t c) {
+                uint64_t n = ((d << 1) & shift) | first;
+                for (size_t k = 0; k < numChunks; k++)
+                    n |= follow[k * 256 + ((d >> (8 * chunks[k])) & 255)];
+                return n & masks[c];
+            };
+
+            const uint8_t *p0 = (const uint8_t *)strs[lanes[0].index].str;
+            const uint8_t *p1 = (const uint8_t *)strs[lanes[1].index].str;
+            const uint8_t *p2 = (const uint8_t *)strs[lanes[2].index].str;
+            const uint8_t *p3 = (const uint8_t *)strs[lanes[3].index].str;
+            size_t pos0 = lanes[0].pos, pos1 = lanes[1].pos;
+            size_t pos2 = lanes[2].pos, pos3 = lanes[3].pos;
+            size_t steps = SIZE_MAX;
+            for (uint32_t j = 0; j < GLUSHKOV_BATCH_LANES; j++)
+                steps = std::min(steps,
+                                 strs[lanes[j].index].len - lanes[j].pos - 1);
+
+            uint64_t d0 = lanes[0].d, d1 = lanes[1].d;
+            uint64_t d2 = lanes[2].d, d3 = lanes[3].d;
+            uint64_t f0 = lanes[0].first, f1 = lanes[1].first;
+            uint64_t f2 = lanes[2].first, f3 = lanes[3].first;
+            size_t i = 0;
+            for (; i < steps; i++) {
+                uint64_t n0 = step(d0, f0, p0[pos0 + i]);
+                uint64_t n1 = step(d1, f1, p1[pos1 + i]);
+                uint64_t n2 = step(d2, f2, p2[pos2 + i]);
+                uint64_t n3 = step(d3, f3, p3[pos3 + i]);
+                if (((n0 | n1 | n2 | n3) & last) != 0)
+                    break;
+                if (anchored) {
+                    if (n0 == 0 || n1 == 0 || n2 == 0 || n3 == 0)
+                        break;
+                    f0 = f1 = f2 = f3 = 0;
+                }
+                d0 = n0;
+                d1 = n1;
+                d2 = n2;
+                d3 = n3;
+            }
+            lanes[0].d = d0;
+            lanes[1].d = d1;
+            lanes[2].d = d2;
+            lanes[3].d = d3;
+            lanes[0].first = f0;
+            lanes[1].first = f1;
+            lanes[2].first = f2;
+            lanes[3].first = f3;
+            for (uint32_t j = 0; j < GLUSHKOV_BATCH_LANES; j++)
+                lanes[j].pos += i;
+        }
+
+        // step every lane by one byte
+        for (uint32_t j = 0; j < active; j++) {
+            Lane &l = lanes[j];
+            const StringRef &r = strs[l.index];
+            uint64_t d = ((l.d << 1) & shift) | l.first;
+            for (size_t k = 0; k < numChunks; k++)
+                d |= follow[k * 256 + ((l.d >> (8 * chunks[k])) & 255)];
+            d &= masks[(uint8_t)r.str[l.pos++]];
+            l.d = d;
+
+            bool found = (d & last) != 0;
+            if (anchored)
+                l.first = 0;
+            if (!found && l.pos < r.len && (d != 0 || !anchored))
+                continue;
+
+            // the string is decided, and the lane is free
+            if (found) {
+                bits[l.index / 64] |= (uint64_t)1 << (l.index % 64);
+                matches++;
+            }
+            lanes[j--] = lanes[--active];
+        }
+    }
+
+    return matches;
+}
+
+bool Glushkov::match(const char *str, size_t len, bool anchored) const {
+    if (m_nullable)
+        return true;
+    if (m_words == 1)
+        return match1(str, len, anchored);
+    return matchN(str, len, anchored);
+}
@@ -0,0 +1,99 @@
+#ifndef GLUSHKOV_HPP
+#define GLUSHKOV_HPP
+
+#include "parser.hpp"
+#include "stringref.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// upper bound of the number of positions of Glushkov, 4 words of 64 bits
+#define GLUSHKOV_MAX_POSITIONS 256
+
+// number of strings which matchBatch scans at once, for which its loop is
+// unrolled
+#define GLUSHKOV_BATCH_LANES 4
+
+// bit-parallel Glushkov automaton, i.e. the NFA without empty transitions
+// whose states are the positions of the bytes in the regex
+//
+// the set of states is a bitmap of one word per 64 positions. the positions
+// are numbered from left to right, so the transition of a concatenation is
+// mostly from p to p + 1, which is a shift as in Shift-And. the other
+// transitions are looked up in a table of 256 entries for every 8 positions
+// which have them. so a byte is matched by a few word operations without
+// any thread list, and the engine is chosen for the patterns which fit.
+//
+// "{min,max}" is expanded to max copies of the operand, and only the
+// existence of a match is decided, not its position nor its groups
+class Glushkov {
+  public:
+    Glushkov();
+
+    // build the automaton of the tree, and return false if it has more than
+    // GLUSHKOV_MAX_POSITIONS positions
+    bool build(const TRTree &tree);
+
+    // return true if str[0..len) has a match
+    // anchored: if true, the match must start at str
+    bool match(const char *str, size_t len, bool anchored = false) const;
+
+    // set the bit i of bits if strs[i] has a match, for every i < n, where
+    // bits has (n + 63) / 64 words, and return the number of matches
+    // the strings are scanned by turns as DFA::matchBatch, if the automaton
+    // has one word
+    size_t matchBatch(const StringRef *strs, size_t n, uint64_t *bits,
+                      bool anchored = false) const;
+
+    // true unless the automaton is built or loaded
+    bool empty() const { return m_masks.empty(); }
+
+    // append the tables to data for a cache file, and set them from data
+    // load returns false if data is not the tables of an automaton
+    void save(std::string &data) const;
+    bool load(const char *data, size_t size);
+
+    // approximate memory used by the tables
+    size_t bytes() const;
+
+    uint32_t numPositions() const { return m_positions; }
+    uint32_t numWords() const { return m_words; }
+
+  private:
+    // first and last positions of a subtree
+    struct Info {
+        std::vector<uint64_t> first;
+        std::vector<uint64_t> last;
+        bool nullable;
+    };
+
+    Info visit(const TRTree &tree, TRIndex n);
+    Info position(const ByteSet &set);
+    void concat(Info &a, const Info &b);
+    void loop(const Info &a);
+
+    bool match1(const char *str, size_t len, bool anchored) const;
+    bool matchN(const char *str, size_t len, bool anchored) const;
+
+    uint32_t m_positions;
+    uint32_t m_words;
+    bool m_nullable; // the empty string matches
+
+    // m_masks[c * m_words..] are the positions of the byte c
+    std::vector<uint64_t> m_masks;
+    std::vector<uint64_t> m_first, m_last;
+
+    // the positions p + 1 which follow p, and the other transitions
+    // m_follow[(i * 256 + b) * m_words..] are the positions following
+    // the positions 8 * m_chunks[i] + j for every bit j of b
+    std::vector<uint64_t> m_shift;
+    std::vector<uint32_t> m_chunks;
+    std::vector<uint64_t> m_follow;
+
+    // the followers of every position while building
+    std::vector<std::vector<uint64_t>> m_followers;
+};
+
+#endif // GLUSHKOV_HPP
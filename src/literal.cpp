@@ -0,0 +1,276 @@
+#include "literal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// upper bound of the size of a class taken as a set of prefixes
+#define MAX_CLASS_PREFIXES 8
+
+// literals of a subexpression
+struct LiteralInfo {
+    bool isExact;       // the subexpression matches only the string exact
+    std::string exact;  // valid if isExact
+    std::string prefix; // every match starts with prefix
+    std::string suffix; // every match ends with suffix
+    std::string inner;  // every match contains inner
+
+    // every match starts with one of prefixes, unless it is empty, and the
+    // subexpression matches only them if prefixesExact
+    std::vector<std::string> prefixes;
+    bool prefixesExact;
+};
+
+static LiteralInfo extract(const TRTree &tree, TRIndex n);
+
+static LiteralInfo makeExact(const std::string &s) {
+    LiteralInfo ret;
+    ret.isExact = true;
+    ret.exact = s;
+    ret.prefix = s;
+    ret.suffix = s;
+    ret.inner = s;
+    ret.prefixes.push_back(s);
+    ret.prefixesExact = true;
+    return ret;
+}
+
+static LiteralInfo makeNone() {
+    LiteralInfo ret;
+    ret.isExact = false;
+    ret.prefixesExact = false;
+    return ret;
+}
+
+// add s to set unless it is already there
+static void addPrefix(std::vector<std::string> &set, const std::string &s) {
+    for (auto &t : set) {
+        if (t == s)
+            return;
+    }
+    set.push_back(s);
+}
+
+// the prefixes of "ab", which are the prefixes of a followed by the ones of
+// b if a matches only its prefixes, and are not too many
+static void concatPrefixes(LiteralInfo &ret, const LiteralInfo &a,
+                           const LiteralInfo &b) {
+    ret.prefixes = a.prefixes;
+    ret.prefixesExact = false;
+    if (!a.prefixesExact || b.prefixes.empty() ||
+        a.prefixes.size() * b.prefixes.size() > MAX_PREFIXES)
+        return;
+
+    ret.prefixes.clear();
+    for (auto &x : a.prefixes) {
+        for (auto &y : b.prefixes)
+            addPrefix(ret.prefixes, x + y);
+    }
+    ret.prefixesExact = b.prefixesExact;
+}
+
+static const std::string &longer(const std::string &a, const std::string &b) {
+    return a.size() >= b.size() ? a : b;
+}
+
+// literals of the concatenation "ab"
+static LiteralInfo concat(const LiteralInfo &a, const LiteralInfo &b) {
+    if (a.isExact && b.isExact)
+        return makeExact(a.exact + b.exact);
+
+    LiteralInfo ret = makeNone();
+    ret.prefix = a.isExact ? a.exact + b.prefix : a.prefix;
+    ret.suffix = b.isExact ? a.suffix + b.exact : b.suffix;
+
+    // a literal may also span the boundary of a and b
+    ret.inner = longer(longer(a.inner, b.inner), a.suffix + b.prefix);
+    ret.inner = longer(ret.inner, longer(ret.prefix, ret.suffix));
+
+    concatPrefixes(ret, a, b);
+    return ret;
+}
+
+// literals of the alternation "a|b"
+static LiteralInfo alternate(const LiteralInfo &a, const LiteralInfo &b) {
+    if (a.isExact && b.isExact && a.exact == b.exact)
+        return a;
+
+    LiteralInfo ret = makeNone();
+
+    // common prefix
+    size_t n = 0;
+    while (n < a.prefix.size() && n < b.prefix.size() &&
+           a.prefix[n] == b.prefix[n])
+        n++;
+    ret.prefix = a.prefix.substr(0, n);
+
+    // common suffix
+    n = 0;
+    while (n < a.suffix.size() && n < b.suffix.size() &&
+           a.suffix[a.suffix.size() - 1 - n] ==
+               b.suffix[b.suffix.size() - 1 - n])
+        n++;
+    ret.suffix = a.suffix.substr(a.suffix.size() - n);
+
+    ret.inner = longer(ret.prefix, ret.suffix);
+
+    // every match starts with a prefix of a or of b
+    if (!a.prefixes.empty() && !b.prefixes.empty()) {
+        ret.prefixes = a.prefixes;
+        for (auto &s : b.prefixes)
+            addPrefix(ret.prefixes, s);
+        ret.prefixesExact = a.prefixesExact && b.prefixesExact;
+        if (ret.prefixes.size() > MAX_PREFIXES) {
+            ret.prefixes.clear();
+            ret.prefixesExact = false;
+        }
+    }
+
+    return ret;
+}
+
+static LiteralInfo extract(const TRTree &tree, TRIndex n) {
+    const TRNode &e = tree[n];
+    switch (e.kind) {
+    case TR_CHAR:
+        return makeExact(std::string(1, e.c));
+    case TR_EXPRS: {
+        LiteralInfo ret = makeExact("");
+        for (uint32_t i = 0; i < e.right; i++)
+            ret = concat(ret, extract(tree, tree.child(n, i)));
+        return ret;
+    }
+    case TR_OR:
+        return alternate(extract(tree, e.left), extract(tree, e.right));
+    case TR_PLUS: {
+        // "e+" starts and ends with a match of e
+        LiteralInfo ret = extract(tree, e.left);
+        ret.isExact = false;
+        ret.prefixesExact = false;
+        return ret;
+    }
+    case TR_REPEAT: {
+        const Repeat &r = tree.repeats[e.right];
+        if (r.min == 0)
+            return makeNone();
+
+        // "e{min,max}" starts and ends with a match of e
+        LiteralInfo ret = extract(tree, e.left);
+        if (r.min != 1 || r.max != 1) {
+            ret.isExact = false;
+            ret.prefixesExact = false;
+        }
+        return ret;
+    }
+    case TR_CAPTURE:
+        return extract(tree, e.left);
+    case TR_STRING:
+        return makeExact(tree.string(n));
+    case TR_MATCH:
+        return makeExact("");
+    case TR_CLASS: {
+        // a class of one byte, like "\.", is a literal, and a small class
+        // is a set of prefixes of one byte
+        const ByteSet &set = tree.classes[e.left];
+        if (set.count() == 1) {
+            int c = 0;
+            while (!set.test(c))
+                c++;
+            return makeExact(std::string(1, (char)c));
+        }
+
+        LiteralInfo ret = makeNone();
+        if (set.count() <= MAX_CLASS_PREFIXES) {
+            for (int c = 0; c < 256; c++) {
+                if (set.test(c))
+                    ret.prefixes.push_back(std::string(1, (char)c));
+            }
+            ret.prefixesExact = true;
+        }
+        return ret;
+    }
+    default:
+        // "*" and "?" may match the empty string
+        return makeNone();
+    }
+}
+
+Literals extractLiterals(const TRTree &tree) {
+    LiteralInfo info = extract(tree, tree.root);
+
+    Literals ret;
+    ret.prefix = info.prefix;
+    ret.inner = info.inner;
+    ret.exact = info.isExact;
+
+    // the prefixes are only worth searching if they are longer than prefix,
+    // and no empty one matches everywhere
+    size_t shortest = std::string::npos;
+    for (auto &s : info.prefixes)
+        shortest = std::min(shortest, s.size());
+    if (info.prefixes.size() >= 2 && shortest > ret.prefix.size()) {
+        ret.prefixes = info.prefixes;
+        ret.prefixesExact = info.prefixesExact;
+    } else {
+        ret.prefixesExact = false;
+    }
+    return ret;
+}
+
+void printLiterals(const Literals &lits) {
+    std::cout << "  prefix: \"" << lits.prefix << "\"" << std::endl;
+    std::cout << "  inner: \"" << lits.inner << "\"" << std::endl;
+    if (!lits.prefixes.empty()) {
+        std::cout << "  prefixes" << (lits.prefixesExact ? " (exact):" : ":");
+        for (auto &s : lits.prefixes)
+            std::cout << " \"" << s << "\"";
+        std::cout << std::endl;
+    }
+}
+
+const char *findLiteral(const char *str, size_t len, const char *lit,
+                        size_t n) {
+    if (n == 0)
+        return str;
+    if (n > len)
+        return nullptr;
+    if (n == 1)
+        return (const char *)memchr(str, lit[0], len);
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // compare the first and the last characters of lit at 16 positions at
+    // once, and compare the rest only where both of them are equal
+    __m128i first = _mm_set1_epi8(lit[0]);
+    __m128i last = _mm_set1_epi8(lit[n - 1]);
+    for (; i + n - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(str + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(str + i + n - 1));
+        uint32_t mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            size_t k = i + __builtin_ctz(mask);
+            if (memcmp(str + k + 1, lit + 1, n - 2) == 0)
+                return str + k;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // the rest, by memchr for the first character
+    while (i + n <= len) {
+        auto p = (const char *)memchr(str + i, lit[0], len - n + 1 - i);
+        if (p == nullptr)
+            return nullptr;
+        if (memcmp(p + 1, lit + 1, n - 1) == 0)
+            return p;
+        i = p - str + 1;
+    }
+
+    return nullptr;
+}
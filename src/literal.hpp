@@ -0,0 +1,33 @@
+#ifndef LITERAL_HPP
+#define LITERAL_HPP
+
+#include "parser.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// upper bound of the number of Literals::prefixes
+#define MAX_PREFIXES 64
+
+// literals which every match of a regex must contain
+struct Literals {
+    std::string prefix; // every match starts with prefix
+    std::string inner;  // every match contains inner, the longest one found
+    bool exact;         // the regex matches only prefix
+
+    // every match starts with one of prefixes, like "GET" or "POST" for
+    // "GET|POST", which is empty unless it tells more than prefix
+    std::vector<std::string> prefixes;
+    bool prefixesExact; // the regex matches only the strings of prefixes
+};
+
+Literals extractLiterals(const TRTree &tree);
+void printLiterals(const Literals &lits);
+
+// find the first occurrence of lit[0..n) in str[0..len)
+// return nullptr if there is none
+const char *findLiteral(const char *str, size_t len, const char *lit,
+                        size_t n);
+
+#endif // LITERAL_HPP
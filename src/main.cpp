@@ -1,63 +1,420 @@
+#include "aot.hpp"
+#include "cache.hpp"
 #include "codegen.hpp"
-#include "eval.hpp"
+#include "dense.hpp"
+#include "glushkov.hpp"
+#include "literal.hpp"
+#include "optimize.hpp"
 #include "parser.hpp"
+#include "regexset.hpp"
+#include "scan.hpp"
+#include "search.hpp"
+#include "simplify.hpp"
+#include "stats.hpp"
 
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <istream>
-#include <sstream>
+#include <string>
+#include <vector>
 
-int main(int argc, char *argv[]) {
-    if (argc <= 2) {
-        std::cout << "usage: " << argv[0] << " regex file" << std::endl;
-        return 1;
+static void usage(const char *cmd) {
+    std::cout << "usage: " << cmd
+              << " [-e pike|dfa|dense|glushkov] [-j N] [-c cache] [-o] [-l]\n"
+              << "       [-s] [--stats[=json]] regex file\n"
+              << "       " << cmd
+              << " [-e pike|dfa] [--stats[=json]] -f patterns file\n"
+              << "       " << cmd << " [-c cache] -g name regex\n"
+              << "  -e engine: match by the engine, or by dense if the DFA "
+                 "of the regex has at\n"
+              << "      most " << DENSE_MAX_TRANSITIONS
+              << " transitions, by glushkov if the regex has at most "
+              << GLUSHKOV_MAX_POSITIONS << "\n"
+              << "      positions and by dfa otherwise by default\n"
+              << "  -j N: scan the file by N threads\n"
+              << "  -c cache: load compiled regexes from the cache file, "
+                 "and save them to it\n"
+              << "  -o: print the groups of the leftmost match, separated by "
+                 "tabs, or the match\n"
+              << "      if there is no group, instead of the line\n"
+              << "  -l: with -o, print the leftmost-longest match instead of "
+                 "the groups of the\n"
+              << "      leftmost-first one\n"
+              << "  -s: print the offsets \"start-end\" of every match, "
+                 "reading the file as a\n"
+              << "      stream, where a match may span lines\n"
+              << "  --stats: print the time of every stage and the counters "
+                 "of the engines to\n"
+              << "      the standard error at exit, as JSON for --stats=json\n"
+              << "  -f patterns: print the lines which match some regex in "
+                 "the file patterns,\n"
+              << "      one per line, with the indexes of the regexes from 0 "
+                 "in one pass\n"
+              << "  -g name: write the header name.hpp with the function "
+                 "\"bool name(const char\n"
+              << "      *str, size_t len)\", which matches the regex by "
+                 "the code of its DFA\n"
+              << "  file: a file name, or - for the standard input"
+              << std::endl;
+}
+
+// print the lines of file which match some regex of patternFile
+static int runSet(const char *patternFile, const char *file, bool useDFA,
+                  bool printStats, bool json) {
+    std::ifstream in(patternFile);
+    if (!in) {
+        std::cerr << "failed to open file: " << patternFile << std::endl;
+        return 2;
     }
 
-    // print regex
-    std::cout << "regex: " << argv[1] << std::endl;
+    std::vector<std::string> patterns;
+    std::string pattern;
+    while (std::getline(in, pattern)) {
+        if (!pattern.empty())
+            patterns.push_back(pattern);
+    }
 
-    // parse regex
-    auto ast = parseRegex(argv[1]);
-    if (ast == nullptr)
+    Stats stats;
+    uint64_t t = nowNanos();
+    RegexSet set;
+    if (!set.compile(patterns, useDFA)) {
+        std::cerr << "failed to compile patterns: " << patternFile
+                  << std::endl;
         return 1;
+    }
+    stats.codeTime = nowNanos() - t;
+    stats.optimizedSize = set.program().code.size();
+
+    std::cout << "patterns: " << set.size() << std::endl;
+    std::cout << "\ncode:" << std::endl;
+    printCode(set.program());
 
-    // print AST
-    std::cout << "\nabstract syntax tree:" << std::endl;
-    printRegex(ast, 0);
+    std::cout << "\nresult:" << std::endl;
 
-    // generate labeled code
-    auto lc = genLCode(ast);
-    std::cout << "\nlabeled code:" << std::endl;
-    printLCode(lc);
+    Writer out(1);
+    t = nowNanos();
+    bool ok = scanSet(set, file, out);
+    out.flush();
+    stats.scanTime = nowNanos() - t;
+    stats.merge(set.stats());
 
-    // generate code
-    auto code = genCode(lc);
-    std::cout << "\ncode:" << std::endl;
-    printCode(code);
+    if (printStats)
+        ::printStats(stats, json, std::cerr);
 
-    // open file
-    std::ifstream ifs(argv[2]);
-    std::string str;
-    if (ifs.fail()) {
-        std::cerr << "failed to open file: " << argv[2] << std::endl;
+    if (!ok) {
+        std::cerr << "failed to open file: " << file << std::endl;
         return 2;
     }
 
-    std::cout << "\nresult:" << std::endl;
+    return 0;
+}
+
+// return true if name is a C++ identifier
+static bool isIdentifier(const char *name) {
+    if (!isalpha((unsigned char)name[0]) && name[0] != '_')
+        return false;
+    for (const char *p = name; *p != '\0'; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_')
+            return false;
+    }
+    return true;
+}
+
+// write the header name.hpp with the matcher of prog (see genDFAHeader)
+static int genHeader(const Program &prog, const char *regex,
+                     const char *name) {
+    // the minimized dense DFA is preferred, and the lazy DFA, whose table
+    // may be larger, is the fallback for the regexes which do not fit in it
+    DenseDFA dense;
+    DFA dfa(prog, AOT_BUDGET);
+    bool useDense = dense.build(prog);
+    if (!useDense && !dfa.build()) {
+        std::cerr << "too many DFA states: " << regex << std::endl;
+        return 1;
+    }
 
-    uint64_t line = 0;
-    while (getline(ifs, str)) {
-        line++;
-        const char *p = str.c_str();
-        while (*p != '\0') {
-            // evaluate regex
-            if (evalRegex(code, p)) {
-                std::cout << line << ": " << str << std::endl;
-                break;
+    std::string file = std::string(name) + ".hpp";
+    std::ofstream out(file);
+    if (!out) {
+        std::cerr << "failed to open file: " << file << std::endl;
+        return 2;
+    }
+    if (useDense)
+        genDFAHeader(dense, name, regex, out);
+    else
+        genDFAHeader(dfa, name, regex, out);
+
+    size_t numStates = useDense ? dense.numStates() : dfa.numStates();
+    std::cout << "\nheader: " << file << " (" << numStates << " states)"
+              << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool useDFA = true;
+    bool useDense = true;
+    bool useGlushkov = true;
+    int jobs = 1;
+    const char *cacheFile = nullptr;
+    const char *patternFile = nullptr;
+    const char *headerName = nullptr;
+    bool captures = false;
+    bool longest = false;
+    bool stream = false;
+    bool printStats = false;
+    bool json = false;
+
+    // parse options
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "pike") == 0) {
+                useDFA = false;
+                useDense = false;
+                useGlushkov = false;
+            } else if (strcmp(argv[i], "dfa") == 0) {
+                useDFA = true;
+                useDense = false;
+                useGlushkov = false;
+            } else if (strcmp(argv[i], "dense") == 0) {
+                useDense = true;
+                useGlushkov = false;
+            } else if (strcmp(argv[i], "glushkov") == 0) {
+                useDense = false;
+                useGlushkov = true;
+            } else {
+                usage(argv[0]);
+                return 1;
             }
-            p++;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            i++;
+            jobs = atoi(argv[i]);
+            if (jobs < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            i++;
+            cacheFile = argv[i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            i++;
+            patternFile = argv[i];
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc &&
+                   isIdentifier(argv[i + 1])) {
+            i++;
+            headerName = argv[i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            captures = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            longest = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            printStats = true;
+            json = true;
+        } else {
+            usage(argv[0]);
+            return 1;
         }
     }
 
+    if (patternFile != nullptr) {
+        // a set is matched line by line by the DFA or the Pike VM alone,
+        // where -e dense and -e glushkov leave only one of the two set
+        bool unsupported = jobs > 1 || cacheFile != nullptr ||
+                           headerName != nullptr || captures || longest ||
+                           stream || useDense != useGlushkov;
+        if (unsupported || argc - i < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return runSet(patternFile, argv[i], useDFA, printStats, json);
+    }
+
+    if (argc - i < (headerName != nullptr ? 1 : 2)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *regex = argv[i];
+    char *file = argv[i + 1];
+
+    // print regex
+    std::cout << "regex: " << regex << std::endl;
+
+    Program prog;
+    Literals lits;
+    Stats stats;
+    TRTree ast;
+    std::shared_ptr<const CompiledRegex> re; // of the cache
+
+    if (cacheFile != nullptr) {
+        // compile regex through the cache, and save it for the next run
+        uint64_t t = nowNanos();
+        RegexCache cache;
+        cache.load(cacheFile);
+
+        re = cache.get(regex, captures);
+        if (re == nullptr)
+            return 1;
+        stats.cacheTime += nowNanos() - t;
+
+        prog = re->prog;
+        lits = re->lits;
+        stats.optimizedSize = prog.code.size();
+
+        std::cout << "\ncode (" << (cache.hits() > 0 ? "cached" : "compiled")
+                  << "):" << std::endl;
+        printCode(prog);
+
+        t = nowNanos();
+        if (cache.misses() > 0 && !cache.save(cacheFile))
+            std::cerr << "failed to save cache: " << cacheFile << std::endl;
+        stats.cacheTime += nowNanos() - t;
+    } else {
+        // parse regex
+        uint64_t t = nowNanos();
+        if (!parseRegex(regex, ast))
+            return 1;
+        stats.parseTime = nowNanos() - t;
+
+        // print AST
+        std::cout << "\nabstract syntax tree:" << std::endl;
+        printRegex(ast, ast.root, 0);
+
+        // simplify AST
+        t = nowNanos();
+        simplifyRegex(ast, captures);
+        stats.simplifyTime = nowNanos() - t;
+        std::cout << "\nsimplified abstract syntax tree:" << std::endl;
+        printRegex(ast, ast.root, 0);
+
+        // generate labeled code
+        t = nowNanos();
+        auto lc = genLCode(ast);
+        stats.lcodeTime = nowNanos() - t;
+        std::cout << "\nlabeled code:" << std::endl;
+        printLCode(lc);
+
+        // generate code
+        t = nowNanos();
+        prog = genCode(lc);
+        stats.codeTime = nowNanos() - t;
+        std::cout << "\ncode:" << std::endl;
+        printCode(prog);
+
+        // optimize code
+        t = nowNanos();
+        stats.codeSize = prog.code.size();
+        optimizeCode(prog, captures);
+        stats.optimizeTime = nowNanos() - t;
+        stats.optimizedSize = prog.code.size();
+        std::cout << "\noptimized code (" << stats.codeSize << " -> "
+                  << stats.optimizedSize << " instructions):" << std::endl;
+        printCode(prog);
+
+        // extract literals for the prefilter
+        t = nowNanos();
+        lits = extractLiterals(ast);
+        stats.literalTime = nowNanos() - t;
+        std::cout << "\nliterals:" << std::endl;
+        printLiterals(lits);
+    }
+
+    if (headerName != nullptr)
+        return genHeader(prog, regex, headerName);
+
+    // the whole match is found by the DFAs of the regex and of the reversed
+    // regex, unless the groups are needed from the Pike VM
+    bool findSpans =
+        captures && (longest || (useDFA && prog.numCaptures == 1));
+
+    // the dense DFA is preferred to the Glushkov automaton, and both are
+    // loaded with a cached regex rather than built
+    DenseDFA dense;
+    useDense = useDense && !stream;
+    if (useDense) {
+        if (re != nullptr)
+            dense = re->dense;
+        else
+            dense.build(prog);
+        useDense = !dense.empty();
+    }
+    if (useDense)
+        useGlushkov = false;
+
+    Glushkov glushkov;
+    if (useGlushkov) {
+        if (re != nullptr)
+            glushkov = re->glushkov;
+        else
+            glushkov.build(ast);
+        useGlushkov = !glushkov.empty();
+    }
+
+    Program reverse;
+    if (findSpans) {
+        if (re != nullptr) {
+            reverse = re->reverse;
+        } else {
+            TRTree rast = ast;
+            reverseRegex(rast);
+            reverse = genCode(genLCode(rast));
+            optimizeCode(reverse, false);
+        }
+        std::cout << "\nreversed code:" << std::endl;
+        printCode(reverse);
+    }
+    if (useDense) {
+        std::cout << "\nengine: dense (" << dense.numStates() << " states, "
+                  << dense.numBuilt() << " before minimization, "
+                  << dense.numClasses() << " byte classes)" << std::endl;
+    } else if (useGlushkov) {
+        std::cout << "\nengine: glushkov (" << glushkov.numPositions()
+                  << " positions, " << glushkov.numWords() << " words)"
+                  << std::endl;
+    } else {
+        std::cout << "\nengine: " << (useDFA ? "dfa" : "pike") << std::endl;
+    }
+    if (findSpans) {
+        std::cout << "spans: "
+                  << (longest ? "leftmost-longest" : "leftmost-first")
+                  << " by the forward and the reversed dfa" << std::endl;
+    }
+
+    std::cout << "\nresult:" << std::endl;
+
+    Writer out(1);
+    bool ok;
+    uint64_t t = nowNanos();
+
+    if (stream) {
+        StreamMatcher matcher(prog);
+        ok = scanMatches(matcher, file, out);
+    } else {
+        Searcher searcher(prog, lits, useDFA, captures,
+                          useGlushkov ? &glushkov : nullptr,
+                          findSpans ? &reverse : nullptr, longest,
+                          useDense ? &dense : nullptr);
+        ok = scanFile(searcher, file, jobs, out);
+        stats.merge(searcher.stats());
+    }
+
+    out.flush();
+    stats.scanTime = nowNanos() - t;
+
+    if (printStats)
+        ::printStats(stats, json, std::cerr);
+
+    if (!ok) {
+        std::cerr << "failed to open file: " << file << std::endl;
+        return 2;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,237 @@
+#include "optimize.hpp"
+
+#include <cassert>
+
+// follow the chain of "jmp" from pc
+// the chain is at most code.size() long unless it is a loop of "jmp"
+static uint32_t threadJump(const std::vector<Inst> &code, uint32_t pc) {
+    for (size_t n = 0; n < code.size() && OPCODE(code[pc]) == OPJMP; n++)
+        pc = OPX(code[pc]);
+    return pc;
+}
+
+// return true if to is reachable from from without consuming a byte
+static bool reachesEmpty(const std::vector<Inst> &code, uint32_t from,
+                         uint32_t to) {
+    std::vector<bool> visited(code.size(), false);
+    std::vector<uint32_t> stack;
+    stack.push_back(from);
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (pc == to)
+            return true;
+        if (visited[pc])
+            continue;
+        visited[pc] = true;
+
+        Inst c = code[pc];
+        switch (OPCODE(c)) {
+        case OPJMP:
+            stack.push_back(OPX(c));
+            break;
+        case OPSPLIT:
+            stack.push_back(OPX(c));
+            stack.push_back(OPY(c));
+            break;
+        case OPREPEAT:
+            stack.push_back(OPY(c));
+            stack.push_back(pc + 1);
+            break;
+        case OPSAVE:
+            stack.push_back(pc + 1);
+            break;
+        default:
+            // "char", "class" and "match"
+            break;
+        }
+    }
+    return false;
+}
+
+// rewrite the targets of the jumps, and return true if something changed
+static bool threadJumps(std::vector<Inst> &code) {
+    bool changed = false;
+    for (uint32_t pc = 0; pc < code.size(); pc++) {
+        Inst c = code[pc];
+        Inst n = c;
+        switch (OPCODE(c)) {
+        case OPJMP: {
+            uint32_t x = threadJump(code, OPX(c));
+            if (OPCODE(code[x]) == OPMATCH)
+                n = code[x]; // "jmp x" to "match" is "match"
+            else
+                n = INST(OPJMP, x, 0);
+            break;
+        }
+        case OPSPLIT: {
+            uint32_t x = threadJump(code, OPX(c));
+            uint32_t y = threadJump(code, OPY(c));
+
+            // split x, x
+            if (x == y) {
+                n = INST(OPJMP, x, 0);
+                break;
+            }
+
+            // an arm to the split itself adds nothing, because the split
+            // is already visited
+            if (x == pc) {
+                n = INST(OPJMP, y, 0);
+                break;
+            }
+            if (y == pc) {
+                n = INST(OPJMP, x, 0);
+                break;
+            }
+
+            // split x, y where x is "split a, y" visits a, y and y, so it
+            // is "jmp x", and split x, y where y is "split x, b" visits x, x
+            // and b, so it is "split x, b"
+            // but if the split is reachable from a (or x), it may be visited
+            // while y (or b) is still waiting on the stack of addThread, and
+            // then the rewrite would change the priority of y (or b)
+            if (OPCODE(code[x]) == OPSPLIT &&
+                threadJump(code, OPY(code[x])) == y &&
+                !reachesEmpty(code, OPX(code[x]), pc)) {
+                n = INST(OPJMP, x, 0);
+                break;
+            }
+            if (OPCODE(code[y]) == OPSPLIT &&
+                threadJump(code, OPX(code[y])) == x &&
+                !reachesEmpty(code, x, pc)) {
+                y = threadJump(code, OPY(code[y]));
+            }
+
+            n = INST(OPSPLIT, x, y);
+            break;
+        }
+        case OPREPEAT:
+            n = INST(OPREPEAT, OPX(c), threadJump(code, OPY(c)));
+            break;
+        default:
+            break;
+        }
+
+        if (n != c) {
+            code[pc] = n;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// mark the instructions reachable from 0
+static std::vector<bool> reachable(const std::vector<Inst> &code) {
+    std::vector<bool> ret(code.size(), false);
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (pc >= code.size() || ret[pc])
+            continue;
+        ret[pc] = true;
+
+        Inst c = code[pc];
+        switch (OPCODE(c)) {
+        case OPMATCH:
+            break;
+        case OPJMP:
+            stack.push_back(OPX(c));
+            break;
+        case OPSPLIT:
+            stack.push_back(OPX(c));
+            stack.push_back(OPY(c));
+            break;
+        case OPREPEAT:
+            stack.push_back(OPY(c));
+            stack.push_back(pc + 1);
+            break;
+        default:
+            // "char", "class" and "save"
+            stack.push_back(pc + 1);
+            break;
+        }
+    }
+    return ret;
+}
+
+// remove the unreachable instructions and the jumps to the next instruction,
+// and renumber the others
+static void removeDeadCode(std::vector<Inst> &code) {
+    std::vector<bool> live = reachable(code);
+
+    // decide which instructions are kept from the last one, so that a jump
+    // is dropped if its target is the next instruction kept
+    std::vector<bool> keep(code.size(), false);
+    size_t next = code.size(); // the next instruction kept
+    for (size_t pc = code.size(); pc-- > 0;) {
+        if (!live[pc])
+            continue;
+        if (OPCODE(code[pc]) == OPJMP && OPX(code[pc]) == next)
+            continue;
+        keep[pc] = true;
+        next = pc;
+    }
+
+    // the new address of every instruction kept, and of every jump dropped,
+    // whose target was threaded to an instruction which is not a jump
+    std::vector<uint32_t> addr(code.size(), 0);
+    uint32_t n = 0;
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        if (keep[pc])
+            addr[pc] = n++;
+    }
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        if (live[pc] && !keep[pc])
+            addr[pc] = addr[OPX(code[pc])];
+    }
+
+    // the entry point stays at 0
+    assert(keep[0] || addr[0] == 0);
+
+    std::vector<Inst> ret;
+    ret.reserve(n);
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        if (!keep[pc])
+            continue;
+
+        Inst c = code[pc];
+        switch (OPCODE(c)) {
+        case OPJMP:
+            c = INST(OPJMP, addr[OPX(c)], 0);
+            break;
+        case OPSPLIT:
+            c = INST(OPSPLIT, addr[OPX(c)], addr[OPY(c)]);
+            break;
+        case OPREPEAT:
+            c = INST(OPREPEAT, OPX(c), addr[OPY(c)]);
+            break;
+        default:
+            break;
+        }
+        ret.push_back(c);
+    }
+
+    code.swap(ret);
+}
+
+void optimizeCode(Program &prog, bool keepSaves) {
+    if (prog.code.empty())
+        return;
+
+    // "save" is "jmp PC+1" for the other engines
+    if (!keepSaves) {
+        for (uint32_t pc = 0; pc < prog.code.size(); pc++) {
+            if (OPCODE(prog.code[pc]) == OPSAVE)
+                prog.code[pc] = INST(OPJMP, pc + 1, 0);
+        }
+    }
+
+    // a few rounds reach the fixed point, and the bound guards against
+    // rewrites which go around a loop of "split"
+    for (int i = 0; i < 16 && threadJumps(prog.code); i++)
+        ;
+    removeDeadCode(prog.code);
+}
@@ -0,0 +1,21 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include "codegen.hpp"
+
+// peephole optimization of the code generated by genCode
+//
+// - jump threading: a jump to "jmp x" jumps to x, and a jump to "match" is
+//   "match"
+// - split flattening: "split x, x" is "jmp x", and an arm which only leads
+//   back to the split or to the other arm is dropped
+// - dead code elimination: the instructions unreachable from 0 and the
+//   jumps to the next instruction are removed, and the rest are renumbered
+//
+// the threads of every engine are visited in the same priority order, so
+// the matches and the captures do not change
+// if keepSaves is false, "save" is removed too, and then the code is only
+// for the engines which do not extract captures
+void optimizeCode(Program &prog, bool keepSaves = true);
+
+#endif // OPTIMIZE_HPP
@@ -1,7 +1,6 @@
 #include "parser.hpp"
 #include <cassert>
 #include <iostream>
-#include <typeindex>
 
 static void printSpaces(int n) {
     for (int i = 0; i < n; i++)
@@ -21,30 +20,228 @@ static bool isChar(char c) {
     return false;
 }
 
-static TRBase *makeUnary(char c, TRBase *expr) {
-    switch (c) {
-    case '+': {
-        TRPlus *ret = new TRPlus;
-        ret->expr = expr;
-        return ret;
+// parse an escape sequence at expr[*pos], which follows '\\'
+// return 0 and store the byte to c for a single byte, like "\n" or "\.",
+// return 1 and store the set to set for a class, like "\d",
+// and return -1 on error
+static int parseEscape(char *expr, int *pos, uint8_t &c, ByteSet &set) {
+    char e = expr[*pos];
+    switch (e) {
+    case 'd':
+    case 'D':
+        set.addRange('0', '9');
+        break;
+    case 'w':
+    case 'W':
+        set.addRange('a', 'z');
+        set.addRange('A', 'Z');
+        set.addRange('0', '9');
+        set.add('_');
+        break;
+    case 's':
+    case 'S':
+        set.add(' ');
+        set.addRange('\t', '\r'); // \t, \n, \v, \f and \r
+        break;
+    case 'n':
+        c = '\n';
+        (*pos)++;
+        return 0;
+    case 't':
+        c = '\t';
+        (*pos)++;
+        return 0;
+    case 'r':
+        c = '\r';
+        (*pos)++;
+        return 0;
+    case 'f':
+        c = '\f';
+        (*pos)++;
+        return 0;
+    case 'v':
+        c = '\v';
+        (*pos)++;
+        return 0;
+    case 'x': {
+        // \xHH
+        int n = 0;
+        for (int i = 1; i <= 2; i++) {
+            char h = expr[*pos + i];
+            if ('0' <= h && h <= '9')
+                n = n * 16 + h - '0';
+            else if ('a' <= h && h <= 'f')
+                n = n * 16 + h - 'a' + 10;
+            else if ('A' <= h && h <= 'F')
+                n = n * 16 + h - 'A' + 10;
+            else
+                return -1;
+        }
+        c = n;
+        *pos += 3;
+        return 0;
     }
-    case '*': {
-        TRStar *ret = new TRStar;
-        ret->expr = expr;
-        return ret;
+    default:
+        if (e == '\0' || isChar(e)) {
+            // an unknown escape of a letter or a digit, like "\q", must be
+            // error, while any other character can be escaped
+            return -1;
+        }
+        c = e;
+        (*pos)++;
+        return 0;
     }
-    case '?': {
-        TRQuestion *ret = new TRQuestion;
-        ret->expr = expr;
-        return ret;
+
+    if ('A' <= e && e <= 'Z')
+        set.invert(); // \D, \W and \S
+    (*pos)++;
+    return 1;
+}
+
+// parse a bracket expression, like "[a-z_]" or "[^0-9]", at expr[*pos],
+// which follows '['
+// return false on error
+static bool parseClass(char *expr, int *pos, ByteSet &set) {
+    bool negate = false;
+    if (expr[*pos] == '^') {
+        negate = true;
+        (*pos)++;
     }
+
+    // ']' right after '[' or "[^" is a character
+    for (bool first = true; first || expr[*pos] != ']'; first = false) {
+        uint8_t lo;
+        switch (expr[*pos]) {
+        case '\0':
+            printErr("error: unmatched bracket", expr, *pos);
+            return false;
+        case '\\': {
+            (*pos)++;
+            ByteSet s;
+            int r = parseEscape(expr, pos, lo, s);
+            if (r < 0) {
+                printErr("error: invalid escape", expr, *pos);
+                return false;
+            } else if (r > 0) {
+                set.merge(s);
+                continue;
+            }
+            break;
+        }
+        default:
+            lo = expr[*pos];
+            (*pos)++;
+            break;
+        }
+
+        // range, like "a-z", where '-' before ']' is a character
+        if (expr[*pos] != '-' || expr[*pos + 1] == ']' ||
+            expr[*pos + 1] == '\0') {
+            set.add(lo);
+            continue;
+        }
+
+        (*pos)++;
+        uint8_t hi = expr[*pos];
+        if (hi == '\\') {
+            (*pos)++;
+            ByteSet s;
+            if (parseEscape(expr, pos, hi, s) != 0) {
+                printErr("error: invalid range", expr, *pos);
+                return false;
+            }
+        } else {
+            (*pos)++;
+        }
+
+        if (hi < lo) {
+            printErr("error: invalid range", expr, *pos - 1);
+            return false;
+        }
+        set.addRange(lo, hi);
+    }
+
+    (*pos)++; // ']'
+
+    if (negate)
+        set.invert();
+    return true;
+}
+
+// parse a number of a counted repetition at expr[*pos]
+// return false if there is no digit or the number is too large
+static bool parseCount(char *expr, int *pos, uint32_t &n) {
+    if (expr[*pos] < '0' || '9' < expr[*pos])
+        return false;
+
+    n = 0;
+    while ('0' <= expr[*pos] && expr[*pos] <= '9') {
+        n = n * 10 + expr[*pos] - '0';
+        if (n > MAX_REPEAT)
+            return false;
+        (*pos)++;
+    }
+    return true;
+}
+
+// parse a counted repetition, "{m}", "{m,}" or "{m,n}", at expr[*pos],
+// which follows '{'
+// return false on error
+static bool parseRepeat(char *expr, int *pos, Repeat &r) {
+    if (!parseCount(expr, pos, r.min)) {
+        printErr("error: invalid repetition count", expr, *pos);
+        return false;
+    }
+
+    if (expr[*pos] == ',') {
+        (*pos)++;
+        if (expr[*pos] == '}') {
+            r.max = REPEAT_INF;
+        } else if (!parseCount(expr, pos, r.max)) {
+            printErr("error: invalid repetition count", expr, *pos);
+            return false;
+        } else if (r.max < r.min) {
+            printErr("error: invalid repetition range", expr, *pos);
+            return false;
+        }
+    } else {
+        r.max = r.min;
+    }
+
+    if (expr[*pos] != '}') {
+        printErr("error: unmatched brace", expr, *pos);
+        return false;
+    }
+    (*pos)++;
+    return true;
+}
+
+static TRKind unaryKind(char c) {
+    switch (c) {
+    case '+':
+        return TR_PLUS;
+    case '*':
+        return TR_STAR;
     default:
-        return nullptr;
+        return TR_QUESTION;
     }
 }
 
-static TRBase *parseRegex(char *expr, int *pos, bool isParen) {
-    TRExprs *ret = new TRExprs;
+// make a TR_EXPRS node of the nodes in stack[base..], and pop them
+static TRIndex makeExprs(TRTree &tree, std::vector<TRIndex> &stack,
+                         size_t base) {
+    TRIndex first = tree.children.size();
+    tree.children.insert(tree.children.end(), stack.begin() + base,
+                         stack.end());
+    stack.resize(base);
+    return tree.add(TR_EXPRS, first, tree.children.size() - first);
+}
+
+// the nodes of the expressions being parsed are pushed to stack, and they
+// are moved to the tree when the expressions end
+static TRIndex parseRegex(char *expr, int *pos, bool isParen, TRTree &tree,
+                          std::vector<TRIndex> &stack) {
+    size_t base = stack.size();
 
     for (;;) {
         switch (expr[*pos]) {
@@ -52,70 +249,71 @@ static TRBase *parseRegex(char *expr, int *pos, bool isParen) {
             if (isParen) {
                 // unmatched parenthesis, like "(ab", must be error
                 printErr("error: unmatched parenthesis", expr, *pos);
-                return nullptr;
+                return TR_NONE;
             }
 
             // match
-            ret->exprs.push_back(new TRMatch);
-            return ret;
+            stack.push_back(tree.add(TR_MATCH));
+            return makeExprs(tree, stack, base);
         case '(': {
             (*pos)++;
-            TRBase *e = parseRegex(expr, pos, true);
-            if (e == nullptr)
-                return nullptr;
 
-            ret->exprs.push_back(e);
+            // "(?:...)" only groups, and "(...)" also captures
+            uint32_t group = 0;
+            if (expr[*pos] == '?' && expr[*pos + 1] == ':')
+                *pos += 2;
+            else
+                group = ++tree.numGroups;
+
+            TRIndex e = parseRegex(expr, pos, true, tree, stack);
+            if (e == TR_NONE)
+                return TR_NONE;
+
+            if (group > 0)
+                e = tree.add(TR_CAPTURE, e, group);
+            stack.push_back(e);
             break;
         }
         case ')':
             if (isParen) {
-                if (ret->exprs.empty()) {
+                if (stack.size() == base) {
                     // empty parenthesis, "()", must be error
                     printErr("error: empty expression", expr, *pos);
-                    return nullptr;
+                    return TR_NONE;
                 }
                 (*pos)++;
-                return ret;
+                return makeExprs(tree, stack, base);
             } else {
                 // unmatched parenthesis, like "ab)", must be error
                 printErr("error: unmatched parenthesis", expr, *pos);
-                return nullptr;
+                return TR_NONE;
             }
         case '|': {
-            if (ret->exprs.empty()) {
+            if (stack.size() == base) {
                 // no left expression, like "|ab", must be error
                 printErr("error: no left expression", expr, *pos);
-                return nullptr;
+                return TR_NONE;
             }
 
-            TROr *orexpr = new TROr;
-            orexpr->left = ret;
+            TRIndex lhs = makeExprs(tree, stack, base);
 
             (*pos)++;
-            TRBase *rhs = parseRegex(expr, pos, isParen);
-            if (rhs == nullptr)
-                return nullptr;
-
-            orexpr->right = rhs;
-
-            std::cout << "Parse or" << std::endl;
-            if (typeid(*rhs) == typeid(TRExprs)) {
-                std::cout << "TRExprs" << std::endl;
-                TRExprs *e = dynamic_cast<TRExprs *>(rhs);
-                assert(e);
-                printRegex(e, 0);
-                auto it = e->exprs.rbegin();
-                if (it != e->exprs.rend()) {
-                    auto ptr = *it;
-                    if (typeid(*ptr) == typeid(TRMatch)) {
-                        std::cout << "TRMatch" << std::endl;
-                        e->exprs.pop_back();
-                        ret = new TRExprs;
-                        ret->exprs.push_back(orexpr);
-                        ret->exprs.push_back(new TRMatch);
-                        return ret;
-                    }
-                }
+            TRIndex rhs = parseRegex(expr, pos, isParen, tree, stack);
+            if (rhs == TR_NONE)
+                return TR_NONE;
+
+            TRIndex orexpr = tree.add(TR_OR, lhs, rhs);
+
+            // "a|b" at the top level is parsed as ("a" | "b match"), so move
+            // the match out of the right expressions: ("a" | "b") match
+            const TRNode &e = tree[rhs];
+            if (e.kind == TR_EXPRS && e.right > 0 &&
+                tree[tree.child(rhs, e.right - 1)].kind == TR_MATCH) {
+                TRIndex match = tree.child(rhs, e.right - 1);
+                tree[rhs].right--;
+                stack.push_back(orexpr);
+                stack.push_back(match);
+                return makeExprs(tree, stack, base);
             }
 
             return orexpr;
@@ -123,81 +321,158 @@ static TRBase *parseRegex(char *expr, int *pos, bool isParen) {
         case '+':
         case '*':
         case '?': {
-            if (ret->exprs.empty()) {
+            if (stack.size() == base) {
                 // no left expression, like "+" or ab(+cd), must be error
                 printErr("error: no left expression", expr, *pos);
-                return nullptr;
+                return TR_NONE;
+            }
+
+            stack.back() = tree.add(unaryKind(expr[*pos]), stack.back());
+            (*pos)++;
+            break;
+        }
+        case '{': {
+            if (stack.size() == base) {
+                // no left expression, like "{2}", must be error
+                printErr("error: no left expression", expr, *pos);
+                return TR_NONE;
             }
 
-            *ret->exprs.rbegin() = makeUnary(expr[*pos], *ret->exprs.rbegin());
             (*pos)++;
+            Repeat r;
+            if (!parseRepeat(expr, pos, r))
+                return TR_NONE;
+
+            stack.back() = tree.addRepeat(stack.back(), r);
+            break;
+        }
+        case '[': {
+            (*pos)++;
+            ByteSet set;
+            if (!parseClass(expr, pos, set))
+                return TR_NONE;
+
+            stack.push_back(tree.addClass(set));
+            break;
+        }
+        case '.': {
+            // any character except newline
+            ByteSet set;
+            set.add('\n');
+            set.invert();
+            stack.push_back(tree.addClass(set));
+            (*pos)++;
+            break;
+        }
+        case '\\': {
+            (*pos)++;
+            uint8_t c;
+            ByteSet set;
+            int r = parseEscape(expr, pos, c, set);
+            if (r < 0) {
+                printErr("error: invalid escape", expr, *pos);
+                return TR_NONE;
+            } else if (r > 0) {
+                stack.push_back(tree.addClass(set));
+            } else {
+                stack.push_back(tree.add(TR_CHAR, TR_NONE, TR_NONE, c));
+            }
             break;
         }
         default:
             if (isChar(expr[*pos])) {
-                TRChar *cexpr = new TRChar;
-                cexpr->c = expr[*pos];
-                ret->exprs.push_back(cexpr);
+                TRIndex c = tree.add(TR_CHAR, TR_NONE, TR_NONE, expr[*pos]);
+                stack.push_back(c);
                 (*pos)++;
             } else {
                 printErr("error: invalid character", expr, *pos);
-                return nullptr;
+                return TR_NONE;
             }
             break;
         }
     }
-
-    return ret;
 }
 
-void printRegex(TRBase *expr, int indent) {
-    if (typeid(*expr) == typeid(TRChar)) {
-        TRChar *e = dynamic_cast<TRChar *>(expr);
-        assert(e);
+void printRegex(const TRTree &tree, TRIndex n, int indent) {
+    const TRNode &e = tree[n];
+    switch (e.kind) {
+    case TR_CHAR:
         printSpaces(indent);
-        std::cout << "char " << e->c << std::endl;
-    } else if (typeid(*expr) == typeid(TRExprs)) {
-        TRExprs *e = dynamic_cast<TRExprs *>(expr);
-        assert(e);
-        for (auto &p : e->exprs) {
-            printRegex(p, indent);
-        }
-    } else if (typeid(*expr) == typeid(TROr)) {
-        TROr *e = dynamic_cast<TROr *>(expr);
-        assert(e);
+        std::cout << "char " << byteString(e.c) << std::endl;
+        break;
+    case TR_EXPRS:
+        for (uint32_t i = 0; i < e.right; i++) {
+            printRegex(tree, tree.child(n, i), indent);
+        }
+        break;
+    case TR_OR:
         printSpaces(indent);
         std::cout << "|" << std::endl;
         printSpaces(indent);
         std::cout << "left:" << std::endl;
-        printRegex(e->left, indent + 4);
+        printRegex(tree, e.left, indent + 4);
         printSpaces(indent);
         std::cout << "right:" << std::endl;
-        printRegex(e->right, indent + 4);
-    } else if (typeid(*expr) == typeid(TRPlus)) {
-        TRPlus *e = dynamic_cast<TRPlus *>(expr);
-        assert(e);
+        printRegex(tree, e.right, indent + 4);
+        break;
+    case TR_PLUS:
         printSpaces(indent);
         std::cout << "+" << std::endl;
-        printRegex(e->expr, indent + 4);
-    } else if (typeid(*expr) == typeid(TRStar)) {
-        TRStar *e = dynamic_cast<TRStar *>(expr);
-        assert(e);
+        printRegex(tree, e.left, indent + 4);
+        break;
+    case TR_STAR:
         printSpaces(indent);
         std::cout << "*" << std::endl;
-        printRegex(e->expr, indent + 4);
-    } else if (typeid(*expr) == typeid(TRQuestion)) {
-        TRQuestion *e = dynamic_cast<TRQuestion *>(expr);
-        assert(e);
+        printRegex(tree, e.left, indent + 4);
+        break;
+    case TR_QUESTION:
         printSpaces(indent);
         std::cout << "?" << std::endl;
-        printRegex(e->expr, indent + 4);
-    } else if (typeid(*expr) == typeid(TRMatch)) {
+        printRegex(tree, e.left, indent + 4);
+        break;
+    case TR_MATCH:
         printSpaces(indent);
         std::cout << "match" << std::endl;
+        break;
+    case TR_CLASS:
+        printSpaces(indent);
+        std::cout << "class " << byteSetString(tree.classes[e.left])
+                  << std::endl;
+        break;
+    case TR_REPEAT:
+        printSpaces(indent);
+        std::cout << repeatString(tree.repeats[e.right]) << std::endl;
+        printRegex(tree, e.left, indent + 4);
+        break;
+    case TR_CAPTURE:
+        printSpaces(indent);
+        std::cout << "group " << e.right << std::endl;
+        printRegex(tree, e.left, indent + 4);
+        break;
+    case TR_STRING: {
+        printSpaces(indent);
+        std::cout << "string ";
+        for (char c : tree.string(n))
+            std::cout << byteString(c);
+        std::cout << std::endl;
+        break;
+    }
     }
 }
 
-TRBase *parseRegex(char *expr) {
+std::string repeatString(const Repeat &r) {
+    std::string s = "{" + std::to_string(r.min);
+    if (r.max == REPEAT_INF)
+        s += ",";
+    else if (r.max != r.min)
+        s += "," + std::to_string(r.max);
+    return s + "}";
+}
+
+bool parseRegex(char *expr, TRTree &tree) {
     int pos = 0;
-    return parseRegex(expr, &pos, false);
-}
\ No newline at end of file
+    std::vector<TRIndex> stack;
+    tree.clear();
+    tree.root = parseRegex(expr, &pos, false, tree, stack);
+    return tree.root != TR_NONE;
+}
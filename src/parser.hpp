@@ -1,48 +1,134 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+#include "byteset.hpp"
+
 #include <cstdint>
+#include <string>
 #include <vector>
 
-class TRBase {
-  public:
-    virtual ~TRBase(){};
+// kinds of nodes of the abstract syntax tree
+enum TRKind : uint8_t {
+    TR_CHAR,
+    TR_OR,
+    TR_PLUS,
+    TR_STAR,
+    TR_QUESTION,
+    TR_EXPRS,
+    TR_MATCH,
+    TR_CLASS,
+    TR_REPEAT,
+    TR_CAPTURE,
+    TR_STRING,
 };
 
-class TRChar : public TRBase {
-  public:
-    char c;
-};
+// index of a node in TRTree
+typedef uint32_t TRIndex;
 
-class TROr : public TRBase {
-  public:
-    TRBase *left;
-    TRBase *right;
-};
+#define TR_NONE ((TRIndex)-1)
 
-class TRPlus : public TRBase {
-  public:
-    TRBase *expr;
+// bounds of a counted repetition, "{min,max}"
+struct Repeat {
+    uint32_t min;
+    uint32_t max; // REPEAT_INF for "{min,}"
 };
 
-class TRStar : public TRBase {
-  public:
-    TRBase *expr;
-};
+#define REPEAT_INF ((uint32_t)-1)
+
+// upper bound of the bounds of "{min,max}"
+#define MAX_REPEAT 1000
 
-class TRQuestion : public TRBase {
-  public:
-    TRBase *expr;
+// node of the abstract syntax tree
+// operands by kind:
+//   TR_CHAR:     c
+//   TR_OR:       left | right
+//   TR_PLUS:     left+
+//   TR_STAR:     left*
+//   TR_QUESTION: left?
+//   TR_EXPRS:    the children are TRTree::children[left..left + right)
+//   TR_MATCH:    none
+//   TR_CLASS:    the set of bytes TRTree::classes[left]
+//   TR_REPEAT:   left{TRTree::repeats[right]}
+//   TR_CAPTURE:  (left), the capture group numbered right from 1
+//   TR_STRING:   the bytes TRTree::text[left..left + right), made by
+//                simplifyRegex
+struct TRNode {
+    TRKind kind;
+    char c;
+    TRIndex left;
+    TRIndex right;
 };
 
-class TRExprs : public TRBase {
-  public:
-    std::vector<TRBase *> exprs;
+// abstract syntax tree
+// every node lives in one arena, nodes, and the children of every TR_EXPRS
+// are contiguous in children, so the tree is freed at once
+struct TRTree {
+    std::vector<TRNode> nodes;
+    std::vector<TRIndex> children;
+    std::vector<ByteSet> classes;
+    std::vector<Repeat> repeats;
+    std::string text; // the bytes of every TR_STRING
+    uint32_t numGroups; // number of capture groups
+    TRIndex root;
+
+    TRTree() : numGroups(0), root(TR_NONE) {}
+
+    const TRNode &operator[](TRIndex n) const { return nodes[n]; }
+    TRNode &operator[](TRIndex n) { return nodes[n]; }
+
+    // the i-th child of the TR_EXPRS node n
+    TRIndex child(TRIndex n, uint32_t i) const {
+        return children[nodes[n].left + i];
+    }
+
+    TRIndex addClass(const ByteSet &set) {
+        classes.push_back(set);
+        return add(TR_CLASS, classes.size() - 1);
+    }
+
+    TRIndex addRepeat(TRIndex e, const Repeat &r) {
+        repeats.push_back(r);
+        return add(TR_REPEAT, e, repeats.size() - 1);
+    }
+
+    TRIndex addString(const std::string &s) {
+        text += s;
+        return add(TR_STRING, text.size() - s.size(), s.size());
+    }
+
+    // the bytes of the TR_STRING node n
+    std::string string(TRIndex n) const {
+        return text.substr(nodes[n].left, nodes[n].right);
+    }
+
+    TRIndex add(TRKind kind, TRIndex left = TR_NONE, TRIndex right = TR_NONE,
+                char c = 0) {
+        TRNode node;
+        node.kind = kind;
+        node.c = c;
+        node.left = left;
+        node.right = right;
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    // discard every node, keeping the memory for the next parse
+    void clear() {
+        nodes.clear();
+        children.clear();
+        classes.clear();
+        repeats.clear();
+        text.clear();
+        numGroups = 0;
+        root = TR_NONE;
+    }
 };
 
-class TRMatch : public TRBase {};
+// parse expr into tree, and return false if expr is invalid
+bool parseRegex(char *expr, TRTree &tree);
+void printRegex(const TRTree &tree, TRIndex n, int indent);
 
-TRBase *parseRegex(char *expr);
-void printRegex(TRBase *expr, int indent);
+// return r as a string, like "{2,5}"
+std::string repeatString(const Repeat &r);
 
-#endif // PARSER_HPP
\ No newline at end of file
+#endif // PARSER_HPP
@@ -0,0 +1,141 @@
+#include "regexset.hpp"
+#include "eval.hpp"
+#include "optimize.hpp"
+#include "parser.hpp"
+#include "simplify.hpp"
+
+#include <algorithm>
+
+// upper bound of the nodes of the copies of "{min,max}" expanded by
+// expandRepeats in a pattern
+#define SET_MAX_REPEAT_NODES 256
+
+// append the code of prog to the code of set, where the addresses, classes
+// and counters are moved after the ones of set, and "match" is "match id"
+static void appendProgram(Program &set, const Program &prog, uint32_t id) {
+    uint32_t base = set.code.size();
+    uint32_t classes = set.classes.size();
+    uint32_t counters = set.counters.size();
+
+    for (auto c : prog.code) {
+        switch (OPCODE(c)) {
+        case OPMATCH:
+            c = INST(OPMATCH, id, 0);
+            break;
+        case OPCLASS:
+            c = INST(OPCLASS, OPX(c) + classes, 0);
+            break;
+        case OPJMP:
+            c = INST(OPJMP, OPX(c) + base, 0);
+            break;
+        case OPSPLIT:
+            c = INST(OPSPLIT, OPX(c) + base, OPY(c) + base);
+            break;
+        case OPREPEAT:
+            c = INST(OPREPEAT, OPX(c) + counters, OPY(c) + base);
+            break;
+        case OPSAVE:
+            // the groups are not extracted
+            c = INST(OPJMP, set.code.size() + 1, 0);
+            break;
+        default:
+            break;
+        }
+        set.code.push_back(c);
+    }
+
+    set.classes.insert(set.classes.end(), prog.classes.begin(),
+                       prog.classes.end());
+    set.counters.insert(set.counters.end(), prog.counters.begin(),
+                        prog.counters.end());
+}
+
+bool mergePrograms(const std::vector<Program> &progs, Program &prog) {
+    if (progs.empty() || progs.size() > MAX_PATTERNS)
+        return false;
+
+    size_t size = progs.size() - 1, classes = 0;
+    for (auto &p : progs) {
+        size += p.code.size();
+        classes += p.classes.size();
+    }
+    if (size > MAX_ADDR || classes > MAX_ADDR)
+        return false;
+
+    prog.code.assign(progs.size() - 1, 0);
+    prog.classes.clear();
+    prog.counters.clear();
+    prog.numCaptures = 1;
+
+    // split start0, 1
+    // split start1, 2
+    // ...
+    // split startN-2, startN-1
+    for (uint32_t i = 0; i < progs.size(); i++) {
+        uint32_t start = prog.code.size();
+        if (i + 1 < progs.size())
+            prog.code[i] = INST(OPSPLIT, start, i + 1);
+        else if (i > 0)
+            prog.code[i - 1] = INST(OPSPLIT, OPX(prog.code[i - 1]), start);
+        appendProgram(prog, progs[i], i);
+    }
+
+    computeByteClasses(prog);
+    return true;
+}
+
+RegexSet::RegexSet() { m_prog.numCaptures = 1; }
+
+bool RegexSet::compile(const std::vector<std::string> &patterns,
+                       bool useDFA) {
+    std::vector<Program> progs;
+    for (auto &pattern : patterns) {
+        std::vector<char> expr(pattern.begin(), pattern.end());
+        expr.push_back('\0');
+
+        TRTree ast;
+        if (!parseRegex(expr.data(), ast))
+            return false;
+        simplifyRegex(ast, false);
+        expandRepeats(ast, SET_MAX_REPEAT_NODES);
+
+        progs.push_back(genCode(genLCode(ast)));
+        optimizeCode(progs.back(), false);
+    }
+
+    m_dfa.reset();
+    if (!mergePrograms(progs, m_prog))
+        return false;
+    optimizeCode(m_prog, false);
+
+    m_patterns = patterns;
+    m_found.assign(patterns.size(), false);
+    if (useDFA)
+        m_dfa.reset(new DFA(m_prog, 1 << 20, false, DFA_ALL));
+    return true;
+}
+
+const std::vector<uint32_t> &RegexSet::match(const char *str, size_t len) {
+    m_ids.clear();
+    m_stats.lines++;
+    m_stats.bytes += len;
+
+    if (m_dfa != nullptr)
+        m_dfa->matchSet(str, len, m_found, m_ids);
+    else
+        searchSet(m_prog, str, len, m_found, m_ids, &m_stats);
+
+    for (uint32_t x : m_ids)
+        m_found[x] = false;
+    std::sort(m_ids.begin(), m_ids.end());
+
+    m_stats.matches += !m_ids.empty();
+    return m_ids;
+}
+
+Stats RegexSet::stats() const {
+    Stats s = m_stats;
+    if (m_dfa != nullptr)
+        m_dfa->addStats(s);
+    return s;
+}
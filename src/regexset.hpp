@@ -0,0 +1,61 @@
+#ifndef REGEXSET_HPP
+#define REGEXSET_HPP
+
+#include "codegen.hpp"
+#include "dfa.hpp"
+#include "stats.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// upper bound of the number of patterns of a RegexSet, the operand of
+// "match x"
+#define MAX_PATTERNS MAX_ADDR
+
+// merge the programs of patterns into one program, whose code starts with a
+// chain of "split" to the code of every pattern, and where the "match" of
+// progs[i] is "match i"
+// return false if the program is too large
+bool mergePrograms(const std::vector<Program> &progs, Program &prog);
+
+// set of regexes which are matched in a single pass
+//
+// the patterns are compiled to one program by mergePrograms, which the Pike
+// VM (see searchSet) or the lazy DFA runs without stopping at a match, so a
+// line is scanned once whatever the number of patterns, and the cost only
+// grows with the number of threads alive at a time
+class RegexSet {
+  public:
+    RegexSet();
+    RegexSet(const RegexSet &) = delete;
+    RegexSet &operator=(const RegexSet &) = delete;
+
+    // parse and compile patterns, where the ID of patterns[i] is i
+    // useDFA: if true, match by the lazy DFA, otherwise by the Pike VM
+    // return false if some pattern is invalid, after printing the error
+    bool compile(const std::vector<std::string> &patterns, bool useDFA = true);
+
+    // return the IDs of the patterns which match str[0..len) in increasing
+    // order, which are valid until the next call
+    const std::vector<uint32_t> &match(const char *str, size_t len);
+
+    size_t size() const { return m_patterns.size(); }
+    const std::string &pattern(uint32_t id) const { return m_patterns[id]; }
+    const Program &program() const { return m_prog; }
+
+    // the counters of the searches so far
+    Stats stats() const;
+
+  private:
+    std::vector<std::string> m_patterns;
+    Program m_prog;
+    std::unique_ptr<DFA> m_dfa; // nullptr for the Pike VM
+
+    std::vector<bool> m_found; // by ID, false between the calls of match
+    std::vector<uint32_t> m_ids;
+
+    Stats m_stats; // the counters but the ones of the DFA
+};
+
+#endif // REGEXSET_HPP
@@ -0,0 +1,451 @@
+#include "scan.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// size of a block read from a pipe or the standard input
+#define SCAN_BLOCK_SIZE (1 << 20)
+
+// lower bound of the size of a chunk scanned by a thread
+#define SCAN_MIN_CHUNK_SIZE (1 << 20)
+
+Writer::Writer(int fd, size_t size) : m_fd(fd), m_buf(size), m_len(0) {}
+
+Writer::~Writer() { flush(); }
+
+void Writer::write(const char *str, size_t len) {
+    if (m_len + len > m_buf.size()) {
+        flush();
+        if (len > m_buf.size()) {
+            // too large to buffer
+            while (len > 0) {
+                ssize_t n = ::write(m_fd, str, len);
+                if (n <= 0)
+                    return;
+                str += n;
+                len -= n;
+            }
+            return;
+        }
+    }
+
+    memcpy(&m_buf[m_len], str, len);
+    m_len += len;
+}
+
+// write "line: "
+void Writer::writeNumber(uint64_t line) {
+    char num[32];
+    char *p = num + sizeof(num);
+    *--p = ' ';
+    *--p = ':';
+    do {
+        *--p = '0' + line % 10;
+        line /= 10;
+    } while (line > 0);
+
+    write(p, num + sizeof(num) - p);
+}
+
+void Writer::writeLine(uint64_t line, const char *str, size_t len) {
+    writeNumber(line);
+    write(str, len);
+    write("\n", 1);
+}
+
+void Writer::writeCaptures(uint64_t line, const char *str,
+                           const size_t *spans, uint32_t n) {
+    writeNumber(line);
+    for (uint32_t i = n > 1 ? 1 : 0; i < n; i++) {
+        if (i > 1)
+            write("\t", 1);
+        if (spans[2 * i] != NO_SPAN && spans[2 * i + 1] != NO_SPAN)
+            write(str + spans[2 * i], spans[2 * i + 1] - spans[2 * i]);
+    }
+    write("\n", 1);
+}
+
+void Writer::writeIds(uint64_t line, const std::vector<uint32_t> &ids,
+                      const char *str, size_t len) {
+    writeNumber(line);
+    for (size_t i = 0; i < ids.size(); i++) {
+        char num[16];
+        int n = snprintf(num, sizeof(num), i > 0 ? ",%u" : "%u", ids[i]);
+        write(num, n);
+    }
+    write(": ", 2);
+    write(str, len);
+    write("\n", 1);
+}
+
+void Writer::writeSpan(uint64_t start, uint64_t end) {
+    char num[64];
+    char *p = num + sizeof(num);
+    *--p = '\n';
+    do {
+        *--p = '0' + end % 10;
+        end /= 10;
+    } while (end > 0);
+    *--p = '-';
+    do {
+        *--p = '0' + start % 10;
+        start /= 10;
+    } while (start > 0);
+
+    write(p, num + sizeof(num) - p);
+}
+
+bool Writer::flush() {
+    const char *p = m_buf.data();
+    while (m_len > 0) {
+        ssize_t n = ::write(m_fd, p, m_len);
+        if (n <= 0) {
+            m_len = 0;
+            return false;
+        }
+        p += n;
+        m_len -= n;
+    }
+    return true;
+}
+
+size_t countLines(const char *str, size_t len) {
+    size_t n = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(str + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(a, nl)));
+    }
+#endif
+
+    for (; i < len; i++)
+        n += str[i] == '\n';
+
+    return n;
+}
+
+// scanBuffer for any output which has writeLine and writeCaptures
+template <typename Out>
+static void scanLines(Searcher &searcher, const char *buf, size_t len,
+                      uint64_t &line, Out &out) {
+    const char *end = buf + len;
+    const char *p = buf;
+    const char *counted = buf; // lines before counted are in line
+
+    while (p < end) {
+        // skip to the line of the next candidate
+        const char *c = searcher.candidate(p, end - p);
+        if (c == nullptr)
+            break;
+
+        const char *head = c;
+        if (c > p) {
+            auto nl = (const char *)memrchr(p, '\n', c - p);
+            head = nl == nullptr ? p : nl + 1;
+        }
+
+        auto tail = (const char *)memchr(c, '\n', end - c);
+        if (tail == nullptr)
+            tail = end;
+
+        if (searcher.match(head, tail - head)) {
+            line += countLines(counted, head - counted);
+            counted = head;
+            if (!searcher.capturing()) {
+                out.writeLine(line + 1, head, tail - head);
+            } else {
+                const size_t *spans = searcher.captures(head, tail - head);
+                if (spans != nullptr)
+                    out.writeCaptures(line + 1, head, spans,
+                                      searcher.numCaptures());
+            }
+        }
+
+        p = tail + 1;
+    }
+
+    line += countLines(counted, end - counted);
+
+    // the last line without '\n'
+    if (len > 0 && end[-1] != '\n')
+        line++;
+}
+
+void scanBuffer(Searcher &searcher, const char *buf, size_t len,
+                uint64_t &line, Writer &out) {
+    scanLines(searcher, buf, len, line, out);
+}
+
+// scanBuffer for a RegexSet, which matches every line
+static void scanBuffer(RegexSet &set, const char *buf, size_t len,
+                       uint64_t &line, Writer &out) {
+    const char *end = buf + len;
+    const char *p = buf;
+    while (p < end) {
+        auto nl = (const char *)memchr(p, '\n', end - p);
+        if (nl == nullptr)
+            nl = end;
+
+        line++;
+        const std::vector<uint32_t> &ids = set.match(p, nl - p);
+        if (!ids.empty())
+            out.writeIds(line, ids, p, nl - p);
+
+        p = nl + 1;
+    }
+}
+
+// a line which matches
+struct Hit {
+    uint64_t line; // line number from the beginning of the chunk
+    const char *str;
+    size_t len;
+    size_t spans; // index of the spans of the groups in Chunk::spans
+};
+
+// a part of a file scanned by a thread
+struct Chunk {
+    const char *buf;
+    size_t len;
+    uint64_t lines; // number of lines in the chunk
+    std::vector<Hit> hits;
+    std::vector<size_t> spans;
+    bool done;
+
+    void writeLine(uint64_t line, const char *str, size_t len) {
+        Hit h = {line, str, len, 0};
+        hits.push_back(h);
+    }
+
+    void writeCaptures(uint64_t line, const char *str, const size_t *s,
+                       uint32_t n) {
+        Hit h = {line, str, 0, spans.size()};
+        hits.push_back(h);
+        spans.insert(spans.end(), s, s + 2 * n);
+    }
+};
+
+// scan buf[0..len) by jobs threads
+//
+// buf is split into newline-aligned chunks, which the threads take in order.
+// every thread has a copy of searcher, because the DFA caches are not
+// shared, counts the lines of its chunks, and adds its counters to searcher
+// when there is no chunk left. the calling thread prints the hits of the
+// chunks in order, and the line numbers are the prefix sums of the line
+// counts.
+static void scanChunks(Searcher &searcher, const char *buf, size_t len,
+                       int jobs, Writer &out) {
+    // about 8 chunks per thread to balance the load
+    size_t size = len / (jobs * 8);
+    if (size < SCAN_MIN_CHUNK_SIZE)
+        size = SCAN_MIN_CHUNK_SIZE;
+
+    std::vector<Chunk> chunks;
+    for (size_t pos = 0; pos < len;) {
+        size_t end = len;
+        if (len - pos > size) {
+            auto nl = (const char *)memchr(buf + pos + size, '\n',
+                                           len - pos - size);
+            if (nl != nullptr)
+                end = nl + 1 - buf;
+        }
+
+        Chunk c;
+        c.buf = buf + pos;
+        c.len = end - pos;
+        c.lines = 0;
+        c.done = false;
+        chunks.push_back(c);
+
+        pos = end;
+    }
+
+    std::atomic<size_t> next(0);
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    auto worker = [&]() {
+        Searcher local(searcher);
+        for (;;) {
+            size_t i = next++;
+            if (i >= chunks.size()) {
+                Stats stats = local.stats();
+                std::lock_guard<std::mutex> lock(mtx);
+                searcher.addStats(stats);
+                return;
+            }
+
+            Chunk &c = chunks[i];
+            scanLines(local, c.buf, c.len, c.lines, c);
+
+            std::lock_guard<std::mutex> lock(mtx);
+            c.done = true;
+            cv.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < jobs; i++)
+        threads.push_back(std::thread(worker));
+
+    // print the chunks in order, as soon as each of them is done
+    uint64_t line = 0;
+    for (auto &c : chunks) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return c.done; });
+        }
+
+        for (auto &h : c.hits) {
+            if (searcher.capturing())
+                out.writeCaptures(line + h.line, h.str, &c.spans[h.spans],
+                                  searcher.numCaptures());
+            else
+                out.writeLine(line + h.line, h.str, h.len);
+        }
+        line += c.lines;
+
+        std::vector<Hit>().swap(c.hits);
+        std::vector<size_t>().swap(c.spans);
+    }
+
+    for (auto &t : threads)
+        t.join();
+}
+
+// scan a file by read(), keeping the incomplete last line for the next block
+// matcher is a Searcher or a RegexSet
+template <typename Matcher>
+static bool scanStream(Matcher &matcher, int fd, Writer &out) {
+    std::vector<char> buf(SCAN_BLOCK_SIZE);
+    size_t len = 0;
+    uint64_t line = 0;
+
+    for (;;) {
+        if (len == buf.size())
+            buf.resize(buf.size() * 2); // a line longer than the buffer
+
+        ssize_t n = read(fd, &buf[len], buf.size() - len);
+        if (n < 0)
+            return false;
+
+        if (n == 0) {
+            // the last line without '\n'
+            scanBuffer(matcher, buf.data(), len, line, out);
+            return true;
+        }
+
+        len += n;
+
+        auto nl = (const char *)memrchr(buf.data(), '\n', len);
+        if (nl == nullptr)
+            continue;
+
+        size_t m = nl + 1 - buf.data();
+        scanBuffer(matcher, buf.data(), m, line, out);
+
+        memmove(buf.data(), buf.data() + m, len - m);
+        len -= m;
+    }
+}
+
+bool scanFile(Searcher &searcher, const char *file, int jobs,
+              Writer &out) {
+    if (strcmp(file, "-") == 0)
+        return scanStream(searcher, 0, out);
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        bool ret = scanStream(searcher, fd, out);
+        close(fd);
+        return ret;
+    }
+
+    size_t len = st.st_size;
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    madvise(addr, len, MADV_SEQUENTIAL);
+
+    if (jobs > 1) {
+        scanChunks(searcher, (const char *)addr, len, jobs, out);
+    } else {
+        uint64_t line = 0;
+        scanBuffer(searcher, (const char *)addr, len, line, out);
+    }
+
+    munmap(addr, len);
+    return true;
+}
+
+bool scanSet(RegexSet &set, const char *file, Writer &out) {
+    if (strcmp(file, "-") == 0)
+        return scanStream(set, 0, out);
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool ret = scanStream(set, fd, out);
+    close(fd);
+    return ret;
+}
+
+bool scanMatches(StreamMatcher &matcher, const char *file, Writer &out) {
+    int fd = 0;
+    if (strcmp(file, "-") != 0) {
+        fd = open(file, O_RDONLY);
+        if (fd < 0)
+            return false;
+    }
+
+    std::vector<char> buf(SCAN_BLOCK_SIZE);
+    bool ret = true;
+    for (;;) {
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if (n < 0) {
+            ret = false;
+            break;
+        }
+
+        if (n == 0)
+            matcher.finish();
+        else
+            matcher.feed(buf.data(), n);
+
+        for (auto &m : matcher.matches())
+            out.writeSpan(m.offset, m.offset + m.length);
+
+        if (n == 0)
+            break;
+    }
+
+    if (fd != 0)
+        close(fd);
+    return ret;
+}
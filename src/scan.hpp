@@ -0,0 +1,73 @@
+#ifndef SCAN_HPP
+#define SCAN_HPP
+
+#include "regexset.hpp"
+#include "search.hpp"
+#include "stream.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// buffered writer to a file descriptor
+// the buffer is written by one write() when it is full, and when flush is
+// called
+class Writer {
+  public:
+    Writer(int fd, size_t size = 1 << 18);
+    ~Writer();
+
+    void write(const char *str, size_t len);
+    void writeLine(uint64_t line, const char *str, size_t len);
+
+    // write the groups of a match in str in the form "line: group1\tgroup2"
+    // spans are the spans of n groups returned by Searcher::captures, and
+    // the whole match is written if there is no group but the group 0
+    void writeCaptures(uint64_t line, const char *str, const size_t *spans,
+                       uint32_t n);
+
+    // write a line which matches patterns of a RegexSet in the form
+    // "line: id1,id2: str"
+    void writeIds(uint64_t line, const std::vector<uint32_t> &ids,
+                  const char *str, size_t len);
+
+    // write the offsets of a match in the form "start-end"
+    void writeSpan(uint64_t start, uint64_t end);
+    bool flush();
+
+  private:
+    void writeNumber(uint64_t line);
+
+    int m_fd;
+    std::vector<char> m_buf;
+    size_t m_len;
+};
+
+// count '\n' in str[0..len)
+size_t countLines(const char *str, size_t len);
+
+// print the lines in buf[0..len) which match, in the form "line: str", or
+// their groups if searcher is capturing
+// buf must start at the beginning of a line, and line is the number of lines
+// before buf, which is advanced by the number of lines in buf
+void scanBuffer(Searcher &searcher, const char *buf, size_t len,
+                uint64_t &line, Writer &out);
+
+// print the lines of the file which match, where "-" is the standard input
+// a regular file is memory-mapped and scanned by jobs threads, and the
+// others are read by large blocks and scanned by the calling thread
+// return false if the file cannot be read
+bool scanFile(Searcher &searcher, const char *file, int jobs, Writer &out);
+
+// print the lines of the file which match some pattern of set with the IDs
+// of the patterns, where "-" is the standard input, which are read by large
+// blocks and scanned by the calling thread
+// return false if the file cannot be read
+bool scanSet(RegexSet &set, const char *file, Writer &out);
+
+// print the offsets of every match in the file, where "-" is the standard
+// input, which is read by fixed-size blocks and searched by matcher, so a
+// match may span any number of blocks and lines
+// return false if the file cannot be read
+bool scanMatches(StreamMatcher &matcher, const char *file, Writer &out);
+
+#endif // SCAN_HPP
@@ -0,0 +1,128 @@
+#include "search.hpp"
+#include "eval.hpp"
+
+Searcher::Searcher(const Program &prog, const Literals &lits, bool useDFA,
+                   bool captures, const Glushkov *glushkov,
+                   const Program *reverse, bool longest,
+                   const DenseDFA *dense)
+    : m_prog(prog), m_lits(lits), m_useDFA(useDFA), m_glushkov(glushkov),
+      m_dense(dense), m_dfa(prog), m_capturing(captures),
+      m_findSpans(reverse != nullptr), m_spans(2 * prog.numCaptures) {
+    m_teddy.build(lits.prefixes);
+    if (m_findSpans)
+        m_finder.reset(new MatchFinder(prog, *reverse, longest));
+    else if (captures)
+        m_captureVM.reset(new CaptureVM(prog));
+}
+
+Searcher::Searcher(const Searcher &other)
+    : m_prog(other.m_prog), m_lits(other.m_lits), m_teddy(other.m_teddy),
+      m_useDFA(other.m_useDFA), m_glushkov(other.m_glushkov),
+      m_dense(other.m_dense), m_dfa(other.m_dfa),
+      m_capturing(other.m_capturing), m_findSpans(other.m_findSpans),
+      m_spans(other.m_spans), m_stats(other.m_stats) {
+    if (other.m_captureVM != nullptr)
+        m_captureVM.reset(new CaptureVM(*other.m_captureVM));
+    if (other.m_finder != nullptr)
+        m_finder.reset(new MatchFinder(*other.m_finder));
+}
+
+// return true if str[0..len) has a match, by the engine alone
+bool Searcher::scan(const char *str, size_t len) {
+    if (m_glushkov != nullptr) {
+        m_stats.glushkovBytes += len;
+        return m_glushkov->match(str, len);
+    }
+    if (m_dense != nullptr) {
+        m_stats.denseBytes += len;
+        return m_dense->match(str, len);
+    }
+    if (m_useDFA)
+        return m_dfa.match(str, len);
+
+    Match m;
+    return searchRegex(m_prog, str, len, m, &m_stats);
+}
+
+bool Searcher::match(const char *str, size_t len) {
+    m_stats.lines++;
+    m_stats.bytes += len;
+    bool found = search(str, len);
+    m_stats.matches += found;
+    return found;
+}
+
+bool Searcher::search(const char *str, size_t len) {
+    const std::string &prefix = m_lits.prefix;
+    const std::string &inner = m_lits.inner;
+
+    // a line without the inner literal never matches
+    if (inner.size() > prefix.size() &&
+        findLiteral(str, len, inner.data(), inner.size()) == nullptr) {
+        m_stats.prefilterRejects++;
+        return false;
+    }
+
+    // every match starts at an occurrence of one of the prefixes, or of
+    // the prefix, so no match starts before the first one, and the engine
+    // scans once from there
+    // (an anchored run at every occurrence would scan the rest of the line
+    // again for each of them)
+    const char *p;
+    bool exact;
+    if (!m_teddy.empty()) {
+        p = m_teddy.find(str, len);
+        exact = m_lits.prefixesExact;
+    } else if (!prefix.empty()) {
+        p = findLiteral(str, len, prefix.data(), prefix.size());
+        exact = m_lits.exact;
+    } else {
+        return scan(str, len);
+    }
+    if (p == nullptr)
+        return false;
+
+    bool found = exact || scan(p, str + len - p);
+    if (found)
+        m_stats.prefilterHits++;
+    else
+        m_stats.prefilterMisses++;
+    return found;
+}
+
+const char *Searcher::candidate(const char *str, size_t len) {
+    const std::string &lit = m_lits.inner;
+    const char *p;
+    if (!lit.empty())
+        p = findLiteral(str, len, lit.data(), lit.size());
+    else if (!m_teddy.empty())
+        p = m_teddy.find(str, len);
+    else
+        return str;
+
+    m_stats.prefilterSkipped += (p != nullptr ? p : str + len) - str;
+    return p;
+}
+
+const size_t *Searcher::captures(const char *str, size_t len) {
+    if (m_findSpans) {
+        Match m;
+        if (!m_finder->find(str, len, m))
+            return nullptr;
+        m_spans[0] = m.offset;
+        m_spans[1] = m.offset + m.length;
+        return m_spans.data();
+    }
+
+    if (!m_captureVM->match(str, len, m_spans.data()))
+        return nullptr;
+    return m_spans.data();
+}
+
+Stats Searcher::stats() const {
+    Stats s = m_stats;
+    m_dfa.addStats(s);
+    if (m_findSpans)
+        m_finder->addStats(s);
+    return s;
+}
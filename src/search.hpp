@@ -0,0 +1,87 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "dense.hpp"
+#include "dfa.hpp"
+#include "eval.hpp"
+#include "finder.hpp"
+#include "glushkov.hpp"
+#include "literal.hpp"
+#include "teddy.hpp"
+
+#include <memory>
+
+// a searcher finds the lines which match a regex
+// candidate positions are found by the required literals of the regex, or
+// by Teddy if every match starts with one of a few literals, and the
+// matching engine runs only from the first of them
+class Searcher {
+  public:
+    // useDFA: if true, match by the lazy DFA, otherwise by the Pike VM
+    // captures: if true, the groups of the matches are printed instead of
+    //           the lines
+    // glushkov: if not nullptr, the automaton of the same regex, which
+    //           matches instead of the DFA or the Pike VM
+    // reverse: if not nullptr, the program of the reversed regex, and then
+    //          only the whole match is captured, by MatchFinder
+    // longest: if true, the match captured by MatchFinder is the
+    //          leftmost-longest one
+    // dense: if not nullptr, the unanchored dense DFA of the same program,
+    //        which matches instead of the lazy DFA where there is no
+    //        literal to search for
+    Searcher(const Program &prog, const Literals &lits, bool useDFA,
+             bool captures = false, const Glushkov *glushkov = nullptr,
+             const Program *reverse = nullptr, bool longest = false,
+             const DenseDFA *dense = nullptr);
+
+    // copy the caches of the DFAs, for a thread of its own
+    Searcher(const Searcher &other);
+
+    // return true if str[0..len) has a match
+    bool match(const char *str, size_t len);
+
+    // return the first position in str[0..len) which may be a part of a
+    // match, that is, the first occurrence of the required literal, or of
+    // one of the prefixes if there is no such literal
+    // return nullptr if str[0..len) never matches
+    const char *candidate(const char *str, size_t len);
+
+    // return the spans of the groups of the leftmost match in str[0..len)
+    // (see CaptureVM), or of the whole match if reverse was given, which
+    // are valid until the next call
+    // only if captures or reverse was given
+    // return nullptr if str[0..len) never matches
+    const size_t *captures(const char *str, size_t len);
+
+    // the counters of the searches so far, with the ones added by addStats
+    Stats stats() const;
+    void addStats(const Stats &stats) { m_stats.merge(stats); }
+
+    bool capturing() const { return m_capturing; }
+    uint32_t numCaptures() const {
+        return m_findSpans ? 1 : m_prog.numCaptures;
+    }
+
+  private:
+    bool search(const char *str, size_t len);
+    bool scan(const char *str, size_t len);
+
+    const Program &m_prog;
+    Literals m_lits;
+    Teddy m_teddy; // of m_lits.prefixes
+    bool m_useDFA;
+    const Glushkov *m_glushkov;
+    const DenseDFA *m_dense;
+    DFA m_dfa;
+
+    // the engines of captures, which are built only if they are used
+    bool m_capturing;
+    std::unique_ptr<CaptureVM> m_captureVM; // unless m_findSpans
+    bool m_findSpans;
+    std::unique_ptr<MatchFinder> m_finder; // if m_findSpans
+    std::vector<size_t> m_spans;
+
+    Stats m_stats; // the counters but the ones of the DFAs
+};
+
+#endif // SEARCH_HPP
@@ -0,0 +1,60 @@
+#ifndef SERIAL_HPP
+#define SERIAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// writers and reader of the data saved in a cache file (see RegexCache),
+// where every integer is in the byte order of the host
+
+inline void putU32(std::string &buf, uint32_t n) {
+    buf.append((const char *)&n, sizeof(n));
+}
+
+// an array of trivially copyable elements, after their number
+template <typename T>
+void putArray(std::string &buf, const std::vector<T> &v) {
+    putU32(buf, v.size());
+    if (!v.empty())
+        buf.append((const char *)v.data(), v.size() * sizeof(T));
+}
+
+// reader of saved data, which checks every bound
+struct Reader {
+    const char *p;
+    const char *end;
+
+    bool getU32(uint32_t &n) {
+        if (end - p < (ptrdiff_t)sizeof(n))
+            return false;
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        return true;
+    }
+
+    bool getBytes(const char *&data, size_t size) {
+        if ((size_t)(end - p) < size)
+            return false;
+        data = p;
+        p += size;
+        return true;
+    }
+
+    // an array written by putArray
+    template <typename T> bool getArray(std::vector<T> &v) {
+        uint32_t n;
+        const char *data;
+        if (!getU32(n) || (size_t)(end - p) / sizeof(T) < n ||
+            !getBytes(data, n * sizeof(T)))
+            return false;
+        v.resize(n);
+        if (n != 0)
+            memcpy(v.data(), data, n * sizeof(T));
+        return true;
+    }
+};
+
+#endif // SERIAL_HPP
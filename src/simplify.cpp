@@ -0,0 +1,422 @@
+#include "simplify.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static TRIndex simplify(TRTree &tree, TRIndex n, bool keepCaptures);
+
+static bool isUnary(TRKind kind) {
+    return kind == TR_PLUS || kind == TR_STAR || kind == TR_QUESTION;
+}
+
+// return true if the subtree at n has a capture group
+static bool hasCapture(const TRTree &tree, TRIndex n) {
+    const TRNode &e = tree[n];
+    switch (e.kind) {
+    case TR_CAPTURE:
+        return true;
+    case TR_EXPRS:
+        for (uint32_t i = 0; i < e.right; i++) {
+            if (hasCapture(tree, tree.child(n, i)))
+                return true;
+        }
+        return false;
+    case TR_OR:
+        return hasCapture(tree, e.left) || hasCapture(tree, e.right);
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION:
+    case TR_REPEAT:
+        return hasCapture(tree, e.left);
+    default:
+        return false;
+    }
+}
+
+// make a TR_EXPRS node of items
+static TRIndex makeExprs(TRTree &tree, const std::vector<TRIndex> &items) {
+    TRIndex first = tree.children.size();
+    tree.children.insert(tree.children.end(), items.begin(), items.end());
+    return tree.add(TR_EXPRS, first, items.size());
+}
+
+// make a chain of TR_OR of alts, nested to the right like the parser does
+static TRIndex makeOr(TRTree &tree, const std::vector<TRIndex> &alts) {
+    TRIndex ret = alts.back();
+    for (size_t i = alts.size() - 1; i-- > 0;)
+        ret = tree.add(TR_OR, alts[i], ret);
+    return ret;
+}
+
+// the sequence of nodes of an alternative, where a string is split into
+// chars, so that a part of it can be factored out
+static std::vector<TRIndex> sequence(TRTree &tree, TRIndex n) {
+    std::vector<TRIndex> items;
+    if (tree[n].kind == TR_EXPRS) {
+        for (uint32_t i = 0; i < tree[n].right; i++)
+            items.push_back(tree.child(n, i));
+    } else {
+        items.push_back(n);
+    }
+
+    std::vector<TRIndex> ret;
+    for (TRIndex item : items) {
+        if (tree[item].kind != TR_STRING) {
+            ret.push_back(item);
+            continue;
+        }
+        for (char c : tree.string(item))
+            ret.push_back(tree.add(TR_CHAR, TR_NONE, TR_NONE, c));
+    }
+    return ret;
+}
+
+// return true if the k-th nodes of a and b from the start, or from the end
+// if suffix is true, are the same char
+static bool sameChar(const TRTree &tree, const std::vector<TRIndex> &a,
+                     const std::vector<TRIndex> &b, size_t k, bool suffix) {
+    if (k >= a.size() || k >= b.size())
+        return false;
+    const TRNode &x = tree[suffix ? a[a.size() - 1 - k] : a[k]];
+    const TRNode &y = tree[suffix ? b[b.size() - 1 - k] : b[k]];
+    return x.kind == TR_CHAR && y.kind == TR_CHAR && x.c == y.c;
+}
+
+// take the common literal prefix, or suffix if suffix is true, out of every
+// run of adjacent alternatives which share the first (or last) char
+static std::vector<TRIndex> factor(TRTree &tree,
+                                   const std::vector<TRIndex> &alts,
+                                   bool suffix, bool keepCaptures) {
+    std::vector<std::vector<TRIndex>> seqs;
+    for (TRIndex alt : alts)
+        seqs.push_back(sequence(tree, alt));
+
+    std::vector<TRIndex> ret;
+    for (size_t i = 0; i < alts.size();) {
+        size_t j = i + 1;
+        while (j < alts.size() && sameChar(tree, seqs[i], seqs[j], 0, suffix))
+            j++;
+        if (j - i < 2) {
+            ret.push_back(alts[i++]);
+            continue;
+        }
+
+        // length of the common part
+        size_t len = 1;
+        for (;;) {
+            size_t k = i + 1;
+            while (k < j && sameChar(tree, seqs[i], seqs[k], len, suffix))
+                k++;
+            if (k < j)
+                break;
+            len++;
+        }
+
+        // the rests of the alternatives, which may be empty
+        std::vector<TRIndex> rests;
+        for (size_t k = i; k < j; k++) {
+            const std::vector<TRIndex> &s = seqs[k];
+            if (suffix)
+                rests.push_back(makeExprs(
+                    tree, std::vector<TRIndex>(s.begin(), s.end() - len)));
+            else
+                rests.push_back(makeExprs(
+                    tree, std::vector<TRIndex>(s.begin() + len, s.end())));
+        }
+
+        // common (rests), or (rests) common
+        const std::vector<TRIndex> &s = seqs[i];
+        std::vector<TRIndex> items;
+        if (suffix) {
+            items.push_back(makeOr(tree, rests));
+            items.insert(items.end(), s.end() - len, s.end());
+        } else {
+            items.insert(items.end(), s.begin(), s.begin() + len);
+            items.push_back(makeOr(tree, rests));
+        }
+        ret.push_back(simplify(tree, makeExprs(tree, items), keepCaptures));
+        i = j;
+    }
+    return ret;
+}
+
+// make a class of every run of adjacent alternatives of one byte
+static std::vector<TRIndex> foldClasses(TRTree &tree,
+                                        const std::vector<TRIndex> &alts) {
+    std::vector<TRIndex> ret;
+    for (size_t i = 0; i < alts.size();) {
+        size_t j = i;
+        ByteSet set;
+        for (; j < alts.size(); j++) {
+            const TRNode &e = tree[alts[j]];
+            if (e.kind == TR_CHAR)
+                set.add(e.c);
+            else if (e.kind == TR_CLASS)
+                set.merge(tree.classes[e.left]);
+            else
+                break;
+        }
+
+        if (j - i < 2) {
+            ret.push_back(alts[i++]);
+            continue;
+        }
+
+        // "a|a" is "a"
+        if (set.count() == 1)
+            ret.push_back(simplify(tree, tree.addClass(set), false));
+        else
+            ret.push_back(tree.addClass(set));
+        i = j;
+    }
+    return ret;
+}
+
+// collect the alternatives of a chain of TR_OR in order, where "(a|b)|c" is
+// "a|b|c"
+static void collectOr(const TRTree &tree, TRIndex n,
+                      std::vector<TRIndex> &alts) {
+    while (tree[n].kind == TR_EXPRS && tree[n].right == 1)
+        n = tree.child(n, 0);
+    if (tree[n].kind == TR_OR) {
+        collectOr(tree, tree[n].left, alts);
+        collectOr(tree, tree[n].right, alts);
+    } else {
+        alts.push_back(n);
+    }
+}
+
+static TRIndex simplifyOr(TRTree &tree, TRIndex n, bool keepCaptures) {
+    std::vector<TRIndex> raw, alts;
+    collectOr(tree, n, raw);
+    for (TRIndex alt : raw)
+        collectOr(tree, simplify(tree, alt, keepCaptures), alts);
+
+    alts = factor(tree, alts, false, keepCaptures);
+    alts = foldClasses(tree, alts);
+    alts = factor(tree, alts, true, keepCaptures);
+
+    if (alts.size() == 1)
+        return alts[0];
+    return makeOr(tree, alts);
+}
+
+static TRIndex simplifyExprs(TRTree &tree, TRIndex n, bool keepCaptures) {
+    // the nested expressions are flattened
+    std::vector<TRIndex> items;
+    for (uint32_t i = 0; i < tree[n].right; i++) {
+        TRIndex e = simplify(tree, tree.child(n, i), keepCaptures);
+        if (tree[e].kind == TR_EXPRS) {
+            for (uint32_t j = 0; j < tree[e].right; j++)
+                items.push_back(tree.child(e, j));
+        } else {
+            items.push_back(e);
+        }
+    }
+
+    // and the adjacent chars and strings are merged into a string
+    std::vector<TRIndex> ret;
+    for (size_t i = 0; i < items.size();) {
+        std::string s;
+        size_t j = i;
+        for (; j < items.size(); j++) {
+            const TRNode &e = tree[items[j]];
+            if (e.kind == TR_CHAR)
+                s += e.c;
+            else if (e.kind == TR_STRING)
+                s += tree.string(items[j]);
+            else
+                break;
+        }
+
+        if (j - i < 2) {
+            ret.push_back(items[i++]);
+            continue;
+        }
+        ret.push_back(tree.addString(s));
+        i = j;
+    }
+
+    if (ret.size() == 1)
+        return ret[0];
+    return makeExprs(tree, ret);
+}
+
+static TRIndex simplify(TRTree &tree, TRIndex n, bool keepCaptures) {
+    // the node is copied, because adding nodes moves the nodes
+    TRNode e = tree[n];
+    switch (e.kind) {
+    case TR_CLASS: {
+        const ByteSet &set = tree.classes[e.left];
+        if (set.count() != 1)
+            return n;
+        int c = 0;
+        while (!set.test(c))
+            c++;
+        return tree.add(TR_CHAR, TR_NONE, TR_NONE, (char)c);
+    }
+    case TR_OR:
+        return simplifyOr(tree, n, keepCaptures);
+    case TR_EXPRS:
+        return simplifyExprs(tree, n, keepCaptures);
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION: {
+        TRIndex x = simplify(tree, e.left, keepCaptures);
+
+        // "x++" is "x+" and "x??" is "x?", and the others are "x*"
+        // but not if x has a group, because an empty iteration of the outer
+        // one may set the group, like "((b)?)+" on ""
+        TRNode inner = tree[x];
+        if (isUnary(inner.kind) && !hasCapture(tree, inner.left)) {
+            TRKind kind = inner.kind == e.kind ? e.kind : TR_STAR;
+            return tree.add(kind, inner.left);
+        }
+
+        if (x == e.left)
+            return n;
+        return tree.add(e.kind, x);
+    }
+    case TR_REPEAT: {
+        TRIndex x = simplify(tree, e.left, keepCaptures);
+        if (x == e.left)
+            return n;
+        return tree.add(TR_REPEAT, x, e.right);
+    }
+    case TR_CAPTURE: {
+        TRIndex x = simplify(tree, e.left, keepCaptures);
+        if (!keepCaptures)
+            return x;
+        if (x == e.left)
+            return n;
+        return tree.add(TR_CAPTURE, x, e.right);
+    }
+    default:
+        // "char", "match" and "string"
+        return n;
+    }
+}
+
+// number of nodes of the subtree at n
+static uint64_t countNodes(const TRTree &tree, TRIndex n) {
+    const TRNode &e = tree[n];
+    uint64_t ret = 1;
+    switch (e.kind) {
+    case TR_EXPRS:
+        for (uint32_t i = 0; i < e.right; i++)
+            ret += countNodes(tree, tree.child(n, i));
+        break;
+    case TR_OR:
+        ret += countNodes(tree, e.left) + countNodes(tree, e.right);
+        break;
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION:
+    case TR_REPEAT:
+    case TR_CAPTURE:
+        ret += countNodes(tree, e.left);
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+static TRIndex expand(TRTree &tree, TRIndex n, uint32_t maxNodes) {
+    TRNode e = tree[n];
+    switch (e.kind) {
+    case TR_EXPRS: {
+        std::vector<TRIndex> items;
+        for (uint32_t i = 0; i < e.right; i++)
+            items.push_back(expand(tree, tree.child(n, i), maxNodes));
+        return makeExprs(tree, items);
+    }
+    case TR_OR:
+        return tree.add(TR_OR, expand(tree, e.left, maxNodes),
+                        expand(tree, e.right, maxNodes));
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION:
+    case TR_CAPTURE:
+        return tree.add(e.kind, expand(tree, e.left, maxNodes), e.right);
+    case TR_REPEAT: {
+        TRIndex x = expand(tree, e.left, maxNodes);
+        Repeat r = tree.repeats[e.right];
+        uint64_t copies = r.max == REPEAT_INF ? (uint64_t)r.min + 1 : r.max;
+        if (copies * (countNodes(tree, x) + 2) > maxNodes)
+            return tree.add(TR_REPEAT, x, e.right);
+
+        std::vector<TRIndex> items(r.min, x);
+        if (r.max == REPEAT_INF) {
+            items.push_back(tree.add(TR_STAR, x));
+        } else if (r.max > r.min) {
+            // x(?:x(?:x)?)? from the innermost one
+            TRIndex opt = tree.add(TR_QUESTION, x);
+            for (uint32_t i = r.min + 1; i < r.max; i++) {
+                std::vector<TRIndex> seq;
+                seq.push_back(x);
+                seq.push_back(opt);
+                opt = tree.add(TR_QUESTION, makeExprs(tree, seq));
+            }
+            items.push_back(opt);
+        }
+        return makeExprs(tree, items);
+    }
+    default:
+        // "char", "class", "match" and "string"
+        return n;
+    }
+}
+
+void expandRepeats(TRTree &tree, uint32_t maxNodes) {
+    if (tree.root != TR_NONE)
+        tree.root = expand(tree, tree.root, maxNodes);
+}
+
+static TRIndex reverse(TRTree &tree, TRIndex n) {
+    TRNode e = tree[n];
+    switch (e.kind) {
+    case TR_EXPRS: {
+        // the match at the end of the root stays at the end
+        uint32_t m = e.right;
+        if (m > 0 && tree[tree.child(n, m - 1)].kind == TR_MATCH)
+            m--;
+        std::vector<TRIndex> items;
+        for (uint32_t i = m; i-- > 0;)
+            items.push_back(reverse(tree, tree.child(n, i)));
+        if (m < e.right)
+            items.push_back(tree.child(n, m));
+        return makeExprs(tree, items);
+    }
+    case TR_OR:
+        return tree.add(TR_OR, reverse(tree, e.left), reverse(tree, e.right));
+    case TR_PLUS:
+    case TR_STAR:
+    case TR_QUESTION:
+    case TR_REPEAT:
+    case TR_CAPTURE:
+        return tree.add(e.kind, reverse(tree, e.left), e.right);
+    case TR_STRING: {
+        std::string s = tree.string(n);
+        std::reverse(s.begin(), s.end());
+        return tree.addString(s);
+    }
+    default:
+        // "char", "class" and "match"
+        return n;
+    }
+}
+
+void reverseRegex(TRTree &tree) {
+    if (tree.root != TR_NONE)
+        tree.root = reverse(tree, tree.root);
+}
+
+void simplifyRegex(TRTree &tree, bool keepCaptures) {
+    if (tree.root == TR_NONE)
+        return;
+    tree.root = simplify(tree, tree.root, keepCaptures);
+    if (!keepCaptures)
+        tree.numGroups = 0;
+}
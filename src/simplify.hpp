@@ -0,0 +1,40 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "parser.hpp"
+
+// rewrite the abstract syntax tree parsed by parseRegex into a smaller one
+//
+// - literal merging: adjacent chars are a TR_STRING, and a class of one byte
+//   is a char
+// - alternation factoring: the common literal prefix and suffix of adjacent
+//   alternatives are taken out, like "abc|abd" to "ab(c|d)" and "ac|bc" to
+//   "(a|b)c", and adjacent alternatives of one byte are a class, like
+//   "a|[bc]" to "[abc]"
+// - nested repetitions are one, like "(?:x*)*" or "x**" to "x*", and
+//   "(?:x+)?" to "x*"
+//
+// only adjacent alternatives are rewritten, so that the priority of the
+// alternatives, i.e. the leftmost-first matches, does not change
+// the capture groups are kept as they are, unless keepCaptures is false,
+// and then the groups are removed, and the tree is only for the engines
+// which do not extract captures
+void simplifyRegex(TRTree &tree, bool keepCaptures = true);
+
+// rewrite "x{min,max}" into min copies of x followed by nested "x?", like
+// "xx(?:x(?:x)?)?" for "x{2,4}", and "x{min,}" into min copies and "x*", if
+// the copies have at most maxNodes nodes in total
+// the code then has no "repeat", whose counters multiply the threads of the
+// Pike VM and the states of the DFA, which matters for the patterns of a
+// RegexSet, whose counters add up
+// the copies share the nodes of x, so it is only for the trees without
+// groups
+void expandRepeats(TRTree &tree, uint32_t maxNodes);
+
+// rewrite the tree into the one of the reversed regex, which matches the
+// reversed strings, like "cb*a" for "ab*c", for the DFA which finds the
+// start of a match backward from its end (see MatchFinder)
+// the groups are kept, but their spans are not the ones of the regex
+void reverseRegex(TRTree &tree);
+
+#endif // SIMPLIFY_HPP
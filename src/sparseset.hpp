@@ -0,0 +1,49 @@
+#ifndef SPARSESET_HPP
+#define SPARSESET_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// sparse set of program counters
+// insert, membership test and clear are O(1), and iteration follows the
+// insertion order, which is the priority order of the threads
+class SparseSet {
+  public:
+    SparseSet(uint32_t n) : m_dense(n), m_sparse(n), m_size(0) {}
+
+    bool contains(uint32_t pc) const {
+        uint32_t i = m_sparse[pc];
+        return i < m_size && m_dense[i] == pc;
+    }
+
+    void insert(uint32_t pc) {
+        m_sparse[pc] = m_size;
+        m_dense[m_size++] = pc;
+    }
+
+    void clear() { m_size = 0; }
+
+    // keep the first n members
+    void truncate(uint32_t n) { m_size = n; }
+
+    void swap(SparseSet &other) {
+        m_dense.swap(other.m_dense);
+        m_sparse.swap(other.m_sparse);
+        std::swap(m_size, other.m_size);
+    }
+
+    bool empty() const { return m_size == 0; }
+    uint32_t size() const { return m_size; }
+    uint32_t operator[](uint32_t i) const { return m_dense[i]; }
+
+    // the members in insertion order
+    const uint32_t *data() const { return m_dense.data(); }
+
+  private:
+    std::vector<uint32_t> m_dense;
+    std::vector<uint32_t> m_sparse;
+    uint32_t m_size;
+};
+
+#endif // SPARSESET_HPP
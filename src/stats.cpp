@@ -0,0 +1,74 @@
+#include "stats.hpp"
+
+#include <chrono>
+
+// the name and the member of every counter
+static const struct {
+    const char *name;
+    uint64_t Stats::*field;
+} fields[] = {
+    {"parse_ns", &Stats::parseTime},
+    {"simplify_ns", &Stats::simplifyTime},
+    {"genlcode_ns", &Stats::lcodeTime},
+    {"gencode_ns", &Stats::codeTime},
+    {"optimize_ns", &Stats::optimizeTime},
+    {"literals_ns", &Stats::literalTime},
+    {"cache_ns", &Stats::cacheTime},
+    {"scan_ns", &Stats::scanTime},
+    {"code_size", &Stats::codeSize},
+    {"optimized_size", &Stats::optimizedSize},
+    {"lines", &Stats::lines},
+    {"matches", &Stats::matches},
+    {"bytes", &Stats::bytes},
+    {"prefilter_skipped", &Stats::prefilterSkipped},
+    {"prefilter_rejects", &Stats::prefilterRejects},
+    {"prefilter_hits", &Stats::prefilterHits},
+    {"prefilter_misses", &Stats::prefilterMisses},
+    {"vm_runs", &Stats::vmRuns},
+    {"vm_bytes", &Stats::vmBytes},
+    {"vm_insts", &Stats::vmInsts},
+    {"vm_threads", &Stats::vmThreads},
+    {"vm_splits", &Stats::vmSplits},
+    {"dfa_bytes", &Stats::dfaBytes},
+    {"dfa_states", &Stats::dfaStates},
+    {"dfa_hits", &Stats::dfaHits},
+    {"dfa_misses", &Stats::dfaMisses},
+    {"dfa_flushes", &Stats::dfaFlushes},
+    {"dfa_fallbacks", &Stats::dfaFallbacks},
+    {"glushkov_bytes", &Stats::glushkovBytes},
+    {"dense_bytes", &Stats::denseBytes},
+};
+
+Stats::Stats() {
+    for (auto &f : fields)
+        this->*f.field = 0;
+}
+
+void Stats::merge(const Stats &other) {
+    for (auto &f : fields)
+        this->*f.field += other.*f.field;
+}
+
+uint64_t nowNanos() {
+    auto d = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+void printStats(const Stats &stats, bool json, std::ostream &out) {
+    if (!json) {
+        for (auto &f : fields)
+            out << f.name << ": " << stats.*f.field << "\n";
+        out.flush();
+        return;
+    }
+
+    out << "{";
+    bool first = true;
+    for (auto &f : fields) {
+        if (!first)
+            out << ", ";
+        out << "\"" << f.name << "\": " << stats.*f.field;
+        first = false;
+    }
+    out << "}" << std::endl;
+}
@@ -0,0 +1,64 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdint>
+#include <ostream>
+
+// counters of the compilation and the searches, printed by --stats
+struct Stats {
+    // time of every compilation stage in nanoseconds
+    uint64_t parseTime;
+    uint64_t simplifyTime;
+    uint64_t lcodeTime;
+    uint64_t codeTime;
+    uint64_t optimizeTime;
+    uint64_t literalTime;
+    uint64_t cacheTime; // loading and saving the cache
+    uint64_t scanTime;
+
+    // number of instructions before and after optimizeCode
+    uint64_t codeSize;
+    uint64_t optimizedSize;
+
+    // Searcher
+    uint64_t lines;   // lines given to Searcher::match, or strings of batches
+    uint64_t matches; // lines which match
+    uint64_t bytes;   // bytes of the lines
+    uint64_t prefilterSkipped; // bytes before the candidates
+    uint64_t prefilterRejects; // lines without the inner literal
+    uint64_t prefilterHits;    // lines which match from the first prefix
+    uint64_t prefilterMisses;  // lines with a prefix which do not match
+
+    // Pike VM
+    uint64_t vmRuns;
+    uint64_t vmBytes;   // positions stepped
+    uint64_t vmInsts;   // instructions in the thread lists of every step
+    uint64_t vmThreads; // threads advanced by "char" and "class"
+    uint64_t vmSplits;  // "split" and "repeat" followed
+
+    // lazy DFA
+    uint64_t dfaBytes;     // bytes scanned
+    uint64_t dfaStates;    // states built, including the flushed ones
+    uint64_t dfaHits;      // transitions found in the cache
+    uint64_t dfaMisses;    // transitions computed
+    uint64_t dfaFlushes;   // flushes of the cache
+    uint64_t dfaFallbacks; // searches by the Pike VM because of thrashing
+
+    // Glushkov
+    uint64_t glushkovBytes; // bytes given to the automaton
+
+    // dense DFA
+    uint64_t denseBytes; // bytes given to the DFA
+
+    Stats();
+
+    void merge(const Stats &other);
+};
+
+// nanoseconds from an arbitrary point, for timing the stages
+uint64_t nowNanos();
+
+// print every counter, in the form "name: value" or as a JSON object
+void printStats(const Stats &stats, bool json, std::ostream &out);
+
+#endif // STATS_HPP
@@ -0,0 +1,142 @@
+#include "stream.hpp"
+
+StreamMatcher::StreamMatcher(const Program &prog)
+    : m_prog(prog), m_clist(prog.code.size(), prog.counters.size()),
+      m_nlist(prog.code.size(), prog.counters.size()),
+      m_slist(prog.code.size(), prog.counters.size()) {
+    m_cstart.reserve(prog.code.size());
+    m_nstart.reserve(prog.code.size());
+    reset();
+}
+
+void StreamMatcher::reset() {
+    m_clist.clear();
+    m_cstart.clear();
+    m_pos = 0;
+    m_pending.clear();
+}
+
+// return the start of the search after m, where an empty match is followed
+// by one byte which is not searched, so that the next match does not start
+// at the same position
+static size_t nextStart(const Match &m) {
+    size_t end = m.offset + m.length;
+    return m.length == 0 ? end + 1 : end;
+}
+
+// add the threads of a match starting at m_pos with the lowest priority
+void StreamMatcher::addSearch() {
+    addThread(m_prog, m_clist, m_stack, 0, nullptr);
+    while (m_cstart.size() < m_clist.size())
+        m_cstart.push_back(m_pos);
+}
+
+// add the threads of a match starting at m_pos after the ones of a match
+// which has just been cut from m_clist
+// the "jmp" and "split" left in m_clist were followed to the cut threads,
+// so they would stop addThread, and only the threads which wait for a byte
+// or "match" are added
+void StreamMatcher::restartSearch() {
+    const std::vector<Inst> &code = m_prog.code;
+
+    m_slist.clear();
+    addThread(m_prog, m_slist, m_stack, 0, nullptr);
+    for (uint32_t j = 0; j < m_slist.size(); j++) {
+        const uint32_t *t = m_slist[j];
+        uint32_t op = OPCODE(code[t[0]]);
+        if ((op == OPCHAR || op == OPCLASS || op == OPMATCH) &&
+            m_clist.insert(t[0], t + 1))
+            m_cstart.push_back(m_pos);
+    }
+}
+
+// run the Pike VM at m_pos like searchRegex, where c is the byte at m_pos,
+// or nullptr at the end of the stream
+void StreamMatcher::step(const char *c) {
+    const std::vector<Inst> &code = m_prog.code;
+
+    // the last search goes on at m_pos
+    addSearch();
+
+    // the threads are in the order of their starts, and then of the
+    // searches, whose index in m_pending is level, and which end at bound
+    size_t level = 0;
+    size_t bound = m_pending.empty() ? SIZE_MAX : nextStart(m_pending[0]);
+    uint32_t i = 0;
+    while (i < m_clist.size()) {
+        while (m_cstart[i] >= bound) {
+            level++;
+            bound = level < m_pending.size() ? nextStart(m_pending[level])
+                                             : SIZE_MAX;
+        }
+
+        uint32_t PC = m_clist[i][0];
+        bool next = false;
+        switch (OPCODE(code[PC])) {
+        case OPMATCH: {
+            // found, which replaces the match of the search, and cuts the
+            // threads of lower priority and the later searches
+            Match m;
+            m.offset = m_cstart[i];
+            m.length = m_pos - m_cstart[i];
+            m_pending.resize(level);
+            m_pending.push_back(m);
+            bound = nextStart(m);
+            m_clist.truncate(i);
+            m_cstart.resize(i);
+
+            // the next search starts at the end of a nonempty match, and
+            // its threads follow from i
+            if (m.length != 0)
+                restartSearch();
+            continue;
+        }
+        case OPCHAR:
+            next = c != nullptr && (char)OPX(code[PC]) == *c;
+            break;
+        case OPCLASS:
+            next = c != nullptr && m_prog.classes[OPX(code[PC])].test(*c);
+            break;
+        default:
+            // the others were already followed by addThread
+            break;
+        }
+
+        if (next) {
+            addThread(m_prog, m_nlist, m_stack, PC + 1, m_clist[i] + 1);
+            while (m_nstart.size() < m_nlist.size())
+                m_nstart.push_back(m_cstart[i]);
+        }
+        i++;
+    }
+
+    m_clist.swap(m_nlist);
+    m_cstart.swap(m_nstart);
+    m_nlist.clear();
+    m_nstart.clear();
+
+    if (c != nullptr)
+        m_pos++;
+
+    // the first match is final once no thread of its search is left, and
+    // then the next one may be
+    while (!m_pending.empty() &&
+           (c == nullptr || m_clist.empty() ||
+            m_cstart[0] >= nextStart(m_pending[0]))) {
+        m_matches.push_back(m_pending.front());
+        m_pending.pop_front();
+    }
+}
+
+size_t StreamMatcher::feed(const char *str, size_t len) {
+    m_matches.clear();
+    for (size_t i = 0; i < len; i++)
+        step(str + i);
+    return m_matches.size();
+}
+
+size_t StreamMatcher::finish() {
+    m_matches.clear();
+    step(nullptr);
+    return m_matches.size();
+}
@@ -0,0 +1,70 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include "eval.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Pike VM which searches a stream given by chunks of any size
+//
+// the threads of the VM are kept between two calls of feed, so a match may
+// span any number of chunks, and the offsets of the matches are counted from
+// the beginning of the stream. the matches are leftmost and do not overlap:
+// the search for the next match starts at the end of the previous one, or
+// after the next byte if the previous match is empty.
+//
+// no byte is kept nor searched again. a match is pending after some thread
+// has reached "match" and until every thread of higher priority has failed,
+// and meanwhile the next search, from the end of the match, runs in the same
+// thread list at a lower priority. a thread belongs to the search after the
+// last pending match which ends before its start, and when a match is
+// replaced, the threads of lower priority are dropped with the later
+// searches. so the threads are at most the instructions, and only the
+// pending matches, which are reported once the first one is final, grow
+// with the stream.
+class StreamMatcher {
+  public:
+    StreamMatcher(const Program &prog);
+
+    // search str[0..len), the next bytes of the stream
+    // return the number of matches found, which are in matches() until the
+    // next call of feed or finish
+    size_t feed(const char *str, size_t len);
+
+    // end the stream, and return the number of the last matches found, which
+    // are in matches(). a match may end at the end of the stream, so the last
+    // match is only found by finish
+    size_t finish();
+
+    // start a new stream
+    void reset();
+
+    const std::vector<Match> &matches() const { return m_matches; }
+
+    // number of bytes of the stream given so far
+    size_t offset() const { return m_pos; }
+
+  private:
+    void step(const char *c);
+    void addSearch();
+    void restartSearch();
+
+    const Program &m_prog;
+
+    ThreadList m_clist, m_nlist;
+    ThreadList m_slist; // threads of a search restarted by restartSearch
+    std::vector<size_t> m_cstart, m_nstart; // starts of the threads
+    std::vector<uint32_t> m_stack;
+
+    size_t m_pos; // position of the next byte given to step
+
+    // the pending match of every search but the last one, where a search
+    // starts at the end of the match of the previous one
+    std::deque<Match> m_pending;
+
+    std::vector<Match> m_matches;
+};
+
+#endif // STREAM_HPP
@@ -0,0 +1,13 @@
+#ifndef STRINGREF_HPP
+#define STRINGREF_HPP
+
+#include <cstddef>
+
+// string which is not owned, like std::string_view, for the batches of
+// strings matched at once
+struct StringRef {
+    const char *str;
+    size_t len;
+};
+
+#endif // STRINGREF_HPP
@@ -0,0 +1,148 @@
+#include "teddy.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef TEDDY_SSSE3
+#include <tmmintrin.h>
+#endif
+
+Teddy::Teddy() : m_width(0) {
+    memset(m_lo, 0, sizeof(m_lo));
+    memset(m_hi, 0, sizeof(m_hi));
+    memset(m_masks, 0, sizeof(m_masks));
+}
+
+bool Teddy::build(const std::vector<std::string> &lits) {
+    if (lits.empty() || lits.size() > TEDDY_MAX_LITERALS)
+        return false;
+
+    m_width = TEDDY_MAX_WIDTH;
+    for (auto &s : lits) {
+        if (s.empty())
+            return false;
+        m_width = std::min(m_width, s.size());
+    }
+
+    // the literals sorted by their leading bytes share the buckets, so that
+    // a bucket is a few literals which look alike
+    m_lits = lits;
+    std::sort(m_lits.begin(), m_lits.end());
+    for (auto &b : m_buckets)
+        b.clear();
+    memset(m_lo, 0, sizeof(m_lo));
+    memset(m_hi, 0, sizeof(m_hi));
+    memset(m_masks, 0, sizeof(m_masks));
+
+    for (uint32_t i = 0; i < m_lits.size(); i++) {
+        uint32_t b = i * TEDDY_BUCKETS / m_lits.size();
+        m_buckets[b].push_back(i);
+        for (size_t k = 0; k < m_width; k++) {
+            uint8_t c = m_lits[i][k];
+            m_lo[k][c & 15] |= 1 << b;
+            m_hi[k][c >> 4] |= 1 << b;
+            m_masks[k][c] |= 1 << b;
+        }
+    }
+    return true;
+}
+
+// return str + i if a literal of buckets starts there
+const char *Teddy::verify(const char *str, size_t len, size_t i,
+                          uint8_t buckets) const {
+    while (buckets != 0) {
+        int b = __builtin_ctz(buckets);
+        buckets &= buckets - 1;
+        for (uint32_t j : m_buckets[b]) {
+            const std::string &s = m_lits[j];
+            if (s.size() <= len - i && memcmp(str + i, s.data(), s.size()) == 0)
+                return str + i;
+        }
+    }
+    return nullptr;
+}
+
+// search from i by the tables of 256 entries
+const char *Teddy::findScalar(const char *str, size_t len, size_t i) const {
+    for (; i + m_width <= len; i++) {
+        uint8_t buckets = m_masks[0][(uint8_t)str[i]];
+        for (size_t k = 1; k < m_width && buckets != 0; k++)
+            buckets &= m_masks[k][(uint8_t)str[i + k]];
+        if (buckets != 0) {
+            const char *p = verify(str, len, i, buckets);
+            if (p != nullptr)
+                return p;
+        }
+    }
+    return nullptr;
+}
+
+#ifdef TEDDY_SSSE3
+// search the blocks of 16 positions from i, where the last block overlaps
+// the one before it, and leave i at the first position which is not searched
+__attribute__((target("ssse3"))) const char *
+Teddy::findSSSE3(const char *str, size_t len, size_t &i) const {
+    __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i lo[TEDDY_MAX_WIDTH], hi[TEDDY_MAX_WIDTH];
+    for (size_t k = 0; k < m_width; k++) {
+        lo[k] = _mm_loadu_si128((const __m128i *)m_lo[k]);
+        hi[k] = _mm_loadu_si128((const __m128i *)m_hi[k]);
+    }
+
+    // the k-th byte of the literals is compared with the block at i + k
+    if (len < 16 + m_width - 1 || i > len - (16 + m_width - 1))
+        return nullptr;
+    size_t last = len - (16 + m_width - 1);
+    for (;; i += 16) {
+        // the last block starts at last, and the positions it searches
+        // again have no literal
+        if (i > last)
+            i = last;
+
+        __m128i buckets = _mm_set1_epi8(-1);
+        for (size_t k = 0; k < m_width; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(str + i + k));
+            __m128i l = _mm_shuffle_epi8(lo[k], _mm_and_si128(v, nibble));
+            __m128i h = _mm_shuffle_epi8(
+                hi[k], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            buckets = _mm_and_si128(buckets, _mm_and_si128(l, h));
+        }
+
+        uint32_t mask = ~_mm_movemask_epi8(
+                            _mm_cmpeq_epi8(buckets, _mm_setzero_si128())) &
+                        0xffff;
+        if (mask != 0) {
+            uint8_t bytes[16];
+            _mm_storeu_si128((__m128i *)bytes, buckets);
+            while (mask != 0) {
+                int j = __builtin_ctz(mask);
+                mask &= mask - 1;
+                const char *p = verify(str, len, i + j, bytes[j]);
+                if (p != nullptr)
+                    return p;
+            }
+        }
+
+        if (i == last) {
+            i = len;
+            return nullptr;
+        }
+    }
+}
+#endif
+
+const char *Teddy::find(const char *str, size_t len) const {
+    if (m_lits.empty())
+        return nullptr;
+
+    size_t i = 0;
+#ifdef TEDDY_SSSE3
+    static const bool ssse3 = __builtin_cpu_supports("ssse3");
+    if (ssse3) {
+        const char *p = findSSSE3(str, len, i);
+        if (p != nullptr)
+            return p;
+    }
+#endif
+    return findScalar(str, len, i);
+}
@@ -0,0 +1,67 @@
+#ifndef TEDDY_HPP
+#define TEDDY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// upper bound of the number of literals of Teddy
+#define TEDDY_MAX_LITERALS 64
+
+// number of buckets, one per bit of a byte of the masks
+#define TEDDY_BUCKETS 8
+
+// number of leading bytes of the literals compared by the masks
+#define TEDDY_MAX_WIDTH 4
+
+// the shuffle is compiled for SSSE3 whatever the flags, and used if the CPU
+// has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEDDY_SSSE3
+#endif
+
+// searcher of a small set of literals, like the alternatives of "GET|POST"
+//
+// the literals are split into 8 buckets, and the first few bytes of every
+// literal set the bit of its bucket in a mask indexed by the low nibble and
+// in a mask indexed by the high nibble of the byte. a position is a
+// candidate if the bit of some bucket is set for each of those bytes, which
+// is decided for 16 positions at once by a shuffle of the masks (SSSE3),
+// and then the literals of the buckets are compared at the candidate.
+// without SSSE3 a table of 256 entries per byte is looked up instead.
+class Teddy {
+  public:
+    Teddy();
+
+    // build the masks of the literals, and return false if there are more
+    // than TEDDY_MAX_LITERALS of them or one is empty
+    bool build(const std::vector<std::string> &lits);
+
+    // return the first position in str[0..len) where a literal starts, or
+    // nullptr if there is none
+    const char *find(const char *str, size_t len) const;
+
+    bool empty() const { return m_lits.empty(); }
+
+  private:
+    const char *verify(const char *str, size_t len, size_t i,
+                       uint8_t buckets) const;
+    const char *findScalar(const char *str, size_t len, size_t i) const;
+#ifdef TEDDY_SSSE3
+    const char *findSSSE3(const char *str, size_t len, size_t &i) const;
+#endif
+
+    std::vector<std::string> m_lits;
+    std::vector<uint32_t> m_buckets[TEDDY_BUCKETS]; // indexes of m_lits
+    size_t m_width; // number of bytes compared by the masks
+
+    // masks of the nibbles of the i-th byte of the literals
+    uint8_t m_lo[TEDDY_MAX_WIDTH][16];
+    uint8_t m_hi[TEDDY_MAX_WIDTH][16];
+
+    // the same masks per byte, for the scalar search
+    uint8_t m_masks[TEDDY_MAX_WIDTH][256];
+};
+
+#endif // TEDDY_HPP
@@ -0,0 +1,149 @@
+#ifndef THREADLIST_HPP
+#define THREADLIST_HPP
+
+#include "sparseset.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// list of threads of the Pike VM
+// a thread is its PC followed by the values of the counters of "repeat",
+// so a thread takes width() words. a thread is in the list at most once, and
+// iteration follows the insertion order, which is the priority order.
+// without counters, threads are just PCs and are kept by a sparse set,
+// otherwise they are kept by a hash table which is cleared in O(size())
+class ThreadList {
+  public:
+    ThreadList(uint32_t numPCs, uint32_t numCounters)
+        : m_width(1 + numCounters), m_size(0),
+          m_pcs(numCounters ? 0 : numPCs) {}
+
+    // insert the thread of pc and counters[0..width() - 1)
+    // return false if it is already in the list
+    bool insert(uint32_t pc, const uint32_t *counters) {
+        if (m_width > 1)
+            return insertCounters(pc, counters);
+
+        if (m_pcs.contains(pc))
+            return false;
+        m_pcs.insert(pc);
+        m_size++;
+        return true;
+    }
+
+    void clear() {
+        if (m_width == 1) {
+            m_pcs.clear();
+        } else {
+            for (auto h : m_slots)
+                m_table[h] = 0;
+            m_slots.clear();
+            m_threads.clear();
+        }
+        m_size = 0;
+    }
+
+    // keep the first n threads
+    // the others were inserted after them, so removing them from the hash
+    // table undoes their insertions, and no probe of the first n passes
+    // through their slots
+    void truncate(uint32_t n) {
+        if (m_width == 1) {
+            m_pcs.truncate(n);
+        } else {
+            for (uint32_t i = n; i < m_size; i++)
+                m_table[m_slots[i]] = 0;
+            m_slots.resize(n);
+            m_threads.resize((size_t)n * m_width);
+        }
+        m_size = n;
+    }
+
+    // exchange the threads with other, without moving them
+    void swap(ThreadList &other) {
+        std::swap(m_width, other.m_width);
+        std::swap(m_size, other.m_size);
+        m_pcs.swap(other.m_pcs);
+        m_threads.swap(other.m_threads);
+        m_table.swap(other.m_table);
+        m_slots.swap(other.m_slots);
+    }
+
+    bool empty() const { return m_size == 0; }
+    uint32_t size() const { return m_size; }
+    uint32_t width() const { return m_width; }
+
+    // the i-th thread, whose PC is operator[](i)[0]
+    const uint32_t *operator[](uint32_t i) const {
+        if (m_width == 1)
+            return m_pcs.data() + i;
+        return &m_threads[(size_t)i * m_width];
+    }
+
+  private:
+    bool insertCounters(uint32_t pc, const uint32_t *counters) {
+        if (2 * (m_size + 1) > m_table.size())
+            grow();
+
+        size_t mask = m_table.size() - 1;
+        size_t h = hash(pc, counters) & mask;
+        for (; m_table[h] != 0; h = (h + 1) & mask) {
+            if (equal(m_table[h] - 1, pc, counters))
+                return false;
+        }
+        m_table[h] = m_size + 1;
+        m_slots.push_back(h);
+
+        m_threads.push_back(pc);
+        m_threads.insert(m_threads.end(), counters, counters + m_width - 1);
+        m_size++;
+        return true;
+    }
+
+    size_t hash(uint32_t pc, const uint32_t *counters) const {
+        // FNV-1a
+        size_t h = (14695981039346656037ULL ^ pc) * 1099511628211ULL;
+        for (uint32_t j = 0; j + 1 < m_width; j++) {
+            h ^= counters[j];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    bool equal(uint32_t i, uint32_t pc, const uint32_t *counters) const {
+        const uint32_t *t = (*this)[i];
+        if (t[0] != pc)
+            return false;
+        for (uint32_t j = 0; j + 1 < m_width; j++) {
+            if (t[j + 1] != counters[j])
+                return false;
+        }
+        return true;
+    }
+
+    // double the hash table, and insert every thread again
+    void grow() {
+        m_table.assign(m_table.empty() ? 64 : 2 * m_table.size(), 0);
+        size_t mask = m_table.size() - 1;
+        for (uint32_t i = 0; i < m_size; i++) {
+            const uint32_t *t = (*this)[i];
+            size_t h = hash(t[0], t + 1) & mask;
+            while (m_table[h] != 0)
+                h = (h + 1) & mask;
+            m_table[h] = i + 1;
+            m_slots[i] = h;
+        }
+    }
+
+    uint32_t m_width;
+    uint32_t m_size;
+    SparseSet m_pcs; // the threads if there is no counter
+
+    std::vector<uint32_t> m_threads; // m_size * m_width words otherwise
+
+    std::vector<uint32_t> m_table; // 1 + index of a thread, or 0 if empty
+    std::vector<size_t> m_slots;   // slot of m_table of every thread
+};
+
+#endif // THREADLIST_HPP